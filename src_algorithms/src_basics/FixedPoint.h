@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "dataStructAlg.h"
+
+// Integer database-unit coordinates, one unit is 1 / resolution of the dsn file (e.g. "(resolution mil 1000)")
+// Points snapped to the unit grid compare and hash exactly: two snapped points are either the same double pair or at least
+// one unit apart, so Point::operator== and Point::Hash agree on them
+struct FixedPoint {
+	int64_t x = 0;
+	int64_t y = 0;
+
+	bool operator==(const FixedPoint& p) const { return x == p.x && y == p.y; }
+	bool operator!=(const FixedPoint& p) const { return !(*this == p); }
+	FixedPoint operator-(const FixedPoint& p) const { return { x - p.x, y - p.y }; }
+};
+
+class FixedGrid {
+public:
+	FixedGrid() {}		// Disabled, coordinates stay as they are
+	// Units finer than 10 * Point::minNumber are coarsened so that snapped points never fall inside the fuzzy compare
+	explicit FixedGrid(double resolution) {
+		if (resolution > 0)
+			m_unit = std::max(1.0 / resolution, 0.001);
+	}
+
+	bool enabled() const { return m_unit > 0; }
+	double unit() const { return m_unit; }
+
+	int64_t toUnits(double v) const { return (int64_t)std::llround(v / m_unit); }
+	double toCoord(int64_t u) const { return (double)u * m_unit; }
+	FixedPoint toFixed(const Point& p) const { return { toUnits(p.x), toUnits(p.y) }; }
+	Point toPoint(const FixedPoint& p) const { return Point(toCoord(p.x), toCoord(p.y)); }
+	// Nearest grid point, p itself if the grid is disabled
+	Point snap(const Point& p) const {
+		if (!enabled()) return p;
+		Point snapped = toPoint(toFixed(p));
+		snapped.setLocked(p.getLocked());
+		return snapped;
+	}
+
+private:
+	double m_unit = 0;
+};
+
+// Exact predicate on unit coordinates, |coordinates| must stay below 2^30 units (about 27 m at 0.001 mil units)
+// Lines ab and cd are parallel (or one of them is degenerate)
+inline bool isParallelFixed(const FixedPoint& a, const FixedPoint& b, const FixedPoint& c, const FixedPoint& d) {
+	FixedPoint u = b - a, v = d - c;
+	return u.x * v.y - u.y * v.x == 0;
+}
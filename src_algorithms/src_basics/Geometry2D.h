@@ -0,0 +1,64 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+#include "dataStructAlg.h"
+
+// Lean geometry primitives for the search and collision hot paths, Point/Line stay at the API boundaries
+// Point also carries a locked flag and its tolerance (32 bytes), Vec2 is two doubles (16 bytes)
+
+struct Vec2 {
+	double x = 0;
+	double y = 0;
+
+	Vec2() {}
+	Vec2(double x, double y) : x(x), y(y) {}
+	Vec2(const Point& p) : x(p.x), y(p.y) {}
+	Point toPoint() const { return Point(x, y); }
+
+	Vec2 operator+(const Vec2& v) const { return { x + v.x, y + v.y }; }
+	Vec2 operator-(const Vec2& v) const { return { x - v.x, y - v.y }; }
+	Vec2 operator*(double k) const { return { x * k, y * k }; }
+	double dot(const Vec2& v) const { return x * v.x + y * v.y; }
+	double cross(const Vec2& v) const { return x * v.y - y * v.x; }
+	double length2() const { return x * x + y * y; }
+	double length() const { return std::sqrt(length2()); }
+	double distanceTo(const Vec2& v) const { return (v - *this).length(); }
+};
+static_assert(sizeof(Vec2) == 16, "Vec2 must stay two doubles");
+
+// Straight segment a->b (32 bytes; Line also carries arc data, width and layer)
+struct Segment {
+	Vec2 a;
+	Vec2 b;
+
+	Segment() {}
+	Segment(const Vec2& a, const Vec2& b) : a(a), b(b) {}
+
+	Vec2 vector() const { return b - a; }
+	double length() const { return vector().length(); }
+	// Distance from p to the segment, same rule as Point::distanceToEdge
+	double distanceTo(const Vec2& p) const {
+		Vec2 ab = b - a;
+		double abLen2 = ab.length2();
+		if (abLen2 < 0.0001)
+			return p.distanceTo(a);
+		double t = std::max(0.0, std::min(1.0, (p - a).dot(ab) / abLen2));
+		return p.distanceTo(a + ab * t);
+	}
+	// Crossing point of the two supporting lines, same rule as Line::getCrossingPoint:
+	// nearly parallel lines give the endpoint of other closest to a
+	Vec2 crossingPoint(const Segment& other) const {
+		Vec2 v1 = vector();
+		Vec2 v2 = other.vector();
+		double crossValue = v1.cross(v2);
+		if (std::abs(crossValue) < MapMinValue)
+			return a.distanceTo(other.a) < a.distanceTo(other.b) ? other.a : other.b;
+		double t = (other.b - b).cross(v2) / crossValue;
+		return b + v1 * t;
+	}
+};
+static_assert(sizeof(Segment) == 32, "Segment must stay four doubles");
+
+using Box = std::array<double, 4>;	// minX, minY, maxX, maxY
@@ -1,6 +1,9 @@
 #pragma once
 #include <vector>
 #include <iostream>
+#include <cmath>
+#include <limits>
+#include <algorithm>
 
 const double MapMinValue = 5e-3;											// Minimum value for various normalized calculations 1e-4
 const double PI = 3.14159265358979323846;									// Pi
@@ -0,0 +1,250 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+
+#include "Grid.h"
+
+// Collision query engine shared by the obstacle scanners of the router
+// queryObstacles walks the cells along a widened segment, filters pads and traces with a filter policy, tests the
+// remaining edges in one SegmentBatch and hands the blocking edges to a result policy
+// queryObstacleFan does the same for a fan of lines from one origin, gathering the obstacles of all corridors once
+
+// Filter policies: which obstacles count and how far the line has to stay away from them
+
+// Obstacles of other nets, optionally ignoring up to two pads
+struct OtherNetsFilter {
+	int netId = -1;
+	double halfWidth = 0;				// Half width of the line being tested
+	double clearance = 0;				// Clearance of its net
+	const PinPad* ignorePad1 = nullptr;
+	const PinPad* ignorePad2 = nullptr;
+
+	bool skipPad(const GridPad& gp) const {
+		return gp.netId == netId || (ignorePad1 && gp.pad == ignorePad1) || (ignorePad2 && gp.pad == ignorePad2);
+	}
+	bool skipTrace(const GridSegment& seg) const { return seg.netId == netId; }
+	// Required distance to a pad outline
+	double padDistance(const PadOutline& outline) const { return halfWidth + std::max(clearance, outline.clearance); }
+	// Required distance to a trace edge, without the trace's own half width
+	double traceClearance(const GridSegment& seg) const { return halfWidth + std::max(clearance, seg.clearance); }
+};
+
+// Search exploration, pads only ask for their own clearance
+struct ExplorationFilter : OtherNetsFilter {
+	double padDistance(const PadOutline& outline) const { return halfWidth + outline.clearance; }
+};
+
+// Result policies: what to keep of the blocking edges (add returns false to stop the query)
+
+// Is the line blocked at all, stops at the first violation
+struct AnyHit {
+	static constexpr bool stopAtFirst = true;
+	bool hit = false;
+
+	bool add(const Segment&, const Segment&, PolyShape*, bool) {
+		hit = true;
+		return false;
+	}
+};
+
+// Obstacle whose blocking edge crosses the line closest to its start point
+struct FirstHit {
+	static constexpr bool stopAtFirst = false;
+	PolyShape* shape = nullptr;
+	double nearest;
+
+	explicit FirstHit(double limit) : nearest(limit) {}
+	bool add(const Segment& query, const Segment& edge, PolyShape* owner, bool isTrace) {
+		double crossDist = query.a.distanceTo(query.crossingPoint(edge));
+		// Traces are ordered by their distance to the start point
+		double orderDist = isTrace ? edge.distanceTo(query.a) : crossDist;
+		if (orderDist < nearest) {
+			nearest = crossDist;
+			shape = owner;
+		}
+		return true;
+	}
+};
+
+// Every blocking obstacle, once each, in the order found
+struct CollectAll {
+	static constexpr bool stopAtFirst = false;
+	std::vector<PolyShape*>& shapes;
+
+	explicit CollectAll(std::vector<PolyShape*>& out) : shapes(out) {}
+	bool add(const Segment&, const Segment&, PolyShape* owner, bool) {
+		if (shapes.empty() || (shapes.back() != owner && std::find(shapes.begin(), shapes.end(), owner) == shapes.end()))
+			shapes.push_back(owner);
+		return true;
+	}
+};
+
+template <typename Result, typename Filter>
+void queryObstacles(const ObstacleIndex& index, ObstacleQuery& query, const Line& line, double width, int layer,
+	const Filter& filter, Result& result)
+{
+	//1. Cells touched by the widened line
+	query.begin(index);
+	index.getCellsAlongLine2(line, width, layer, query.cells);
+	const Segment q(line.Pt1, line.Pt2);
+	SegmentBatch& batch = query.batch;
+	std::vector<PolyShape*>& owners = query.batchShapes;
+	auto report = [&](size_t padEdges) {
+		for (size_t i = 0; i < batch.size(); ++i) {
+			if (batch.violation[i] <= 0) continue;
+			if (!result.add(q, Segment(Vec2(batch.x1[i], batch.y1[i]), Vec2(batch.x2[i], batch.y2[i])), owners[i], i >= padEdges))
+				return false;
+		}
+		return true;
+	};
+
+	//2. Pad edges, each pad once, skipping pads whose inflated outline the line misses
+	for (GridCell* cell : query.cells) {
+		for (const GridPad& gp : cell->getPinPads()) {
+			if (filter.skipPad(gp) || !query.visitPad(gp.padId)) continue;
+			const PadOutline* outline = gp.outline(layer);
+			if (!outline) continue;
+			double minDist = filter.padDistance(*outline);
+			if (!gp.mayBlock(q.a, q.b, minDist)) continue;
+			for (const Segment& edge : outline->edges) {
+				batch.add(edge.a, edge.b, minDist - MapMinValue);
+				owners.push_back(outline->shape);
+			}
+		}
+	}
+	size_t padEdges = batch.size();
+	if constexpr (Result::stopAtFirst) {
+		if (padEdges > 0 && findBlockingEdges(q.a, q.b, batch) > 0 && !report(padEdges))
+			return;
+		batch.clear();
+		owners.clear();
+		padEdges = 0;
+	}
+
+	//3. Trace segments
+	for (GridCell* cell : query.cells) {
+		for (const GridSegment& seg : cell->getPathLines()) {
+			if (filter.skipTrace(seg)) continue;
+			double clearance = filter.traceClearance(seg);
+			if (!seg.mayBlock(q.a, q.b, clearance)) continue;
+			batch.add(seg.p1, seg.p2, clearance + seg.halfWidth - MapMinValue);
+			owners.push_back(seg.shape);
+		}
+	}
+
+	//4. Blocking edges in gathering order, pads first
+	if (batch.size() > 0 && findBlockingEdges(q.a, q.b, batch) > 0)
+		report(padEdges);
+}
+
+namespace collision_detail {
+
+// Candidates of the merged fan cells: pads once each, traces once per cell, with the corridors they lie in
+template <typename Filter>
+void gatherFanCandidates(ObstacleQuery& query, const Filter& filter) {
+	for (const ObstacleQuery::FanCell& fc : query.fanCells) {
+		for (const GridPad& gp : fc.cell->getPinPads()) {
+			if (filter.skipPad(gp)) continue;
+			uint32_t slot = (uint32_t)query.candidatePads.size();
+			if (query.visitPad(gp.padId, slot)) {
+				query.candidatePads.push_back(&gp);
+				query.padMasks.push_back(0);
+			}
+			query.padMasks[slot] |= fc.mask;
+		}
+	}
+	for (const ObstacleQuery::FanCell& fc : query.fanCells) {
+		for (const GridSegment& seg : fc.cell->getPathLines()) {
+			if (filter.skipTrace(seg)) continue;
+			query.candidateTraces.push_back(&seg);
+			query.traceMasks.push_back(fc.mask);
+		}
+	}
+}
+
+// Test segment q against the candidates whose mask has lineBit, same steps as queryObstacles
+template <typename Result, typename Filter>
+void testFanLine(ObstacleQuery& query, const Segment& q, uint64_t lineBit, int layer, const Filter& filter, Result& result) {
+	SegmentBatch& batch = query.batch;
+	std::vector<PolyShape*>& owners = query.batchShapes;
+	batch.clear();
+	owners.clear();
+	auto report = [&](size_t padEdges) {
+		for (size_t i = 0; i < batch.size(); ++i) {
+			if (batch.violation[i] <= 0) continue;
+			if (!result.add(q, Segment(Vec2(batch.x1[i], batch.y1[i]), Vec2(batch.x2[i], batch.y2[i])), owners[i], i >= padEdges))
+				return false;
+		}
+		return true;
+	};
+
+	for (size_t c = 0; c < query.candidatePads.size(); ++c) {
+		if (!(query.padMasks[c] & lineBit)) continue;
+		const PadOutline* outline = query.candidatePads[c]->outline(layer);
+		if (!outline) continue;
+		double minDist = filter.padDistance(*outline);
+		if (!query.candidatePads[c]->mayBlock(q.a, q.b, minDist)) continue;
+		for (const Segment& edge : outline->edges) {
+			batch.add(edge.a, edge.b, minDist - MapMinValue);
+			owners.push_back(outline->shape);
+		}
+	}
+	size_t padEdges = batch.size();
+	if constexpr (Result::stopAtFirst) {
+		if (padEdges > 0 && findBlockingEdges(q.a, q.b, batch) > 0 && !report(padEdges))
+			return;
+		batch.clear();
+		owners.clear();
+		padEdges = 0;
+	}
+
+	for (size_t c = 0; c < query.candidateTraces.size(); ++c) {
+		if (!(query.traceMasks[c] & lineBit)) continue;
+		const GridSegment* seg = query.candidateTraces[c];
+		double clearance = filter.traceClearance(*seg);
+		if (!seg->mayBlock(q.a, q.b, clearance)) continue;
+		batch.add(seg->p1, seg->p2, clearance + seg->halfWidth - MapMinValue);
+		owners.push_back(seg->shape);
+	}
+
+	if (batch.size() > 0 && findBlockingEdges(q.a, q.b, batch) > 0)
+		report(padEdges);
+}
+
+}
+
+// Fan of lines from one origin: the cells of all corridors are merged and their obstacles gathered once, each line is
+// then tested against the candidates of its own corridor; results[i] receives the hits of origin->targets[i]
+template <typename Result, typename Filter>
+void queryObstacleFan(const ObstacleIndex& index, ObstacleQuery& query, const Point& origin, const std::vector<Point>& targets,
+	double width, int layer, const Filter& filter, std::vector<Result>& results)
+{
+	using FanCell = ObstacleQuery::FanCell;
+	for (size_t first = 0; first < targets.size(); first += 64) {
+		size_t last = std::min(first + 64, targets.size());
+		query.begin(index);
+		std::vector<FanCell>& fanCells = query.fanCells;
+		for (size_t i = first; i < last; ++i) {
+			index.getCellsAlongLine2(Line(origin, targets[i]), width, layer, query.lineCells);
+			for (GridCell* cell : query.lineCells)
+				fanCells.push_back({ cell, fanCells.size(), uint64_t(1) << (i - first) });
+		}
+		// Merge the cells shared by several corridors, then restore the order of first appearance
+		std::sort(fanCells.begin(), fanCells.end(), [](const FanCell& a, const FanCell& b) {
+			return a.cell != b.cell ? std::less<GridCell*>()(a.cell, b.cell) : a.order < b.order;
+		});
+		size_t merged = 0;
+		for (size_t c = 0; c < fanCells.size(); ++c) {
+			if (merged > 0 && fanCells[merged - 1].cell == fanCells[c].cell)
+				fanCells[merged - 1].mask |= fanCells[c].mask;
+			else
+				fanCells[merged++] = fanCells[c];
+		}
+		fanCells.resize(merged);
+		std::sort(fanCells.begin(), fanCells.end(), [](const FanCell& a, const FanCell& b) { return a.order < b.order; });
+
+		collision_detail::gatherFanCandidates(query, filter);
+		for (size_t i = first; i < last; ++i)
+			collision_detail::testFanLine(query, Segment(origin, targets[i]), uint64_t(1) << (i - first), layer, filter, results[i]);
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+
+#include "../src_basics/Geometry2D.h"
+
+// Via congestion samples of getCongestionSum, bucketed in square tiles
+// A sample is the number of foreign pad edges within reach of one point for one net and layer range; pads only enter or
+// leave the index one at a time, so a pad change drops just the tiles within reach of its box and the rest stays valid
+class CongestionField {
+public:
+	struct Key {
+		int64_t x, y;						// Sample point quantized to Point::minNumber
+		int layer1, layer2;
+		int netId;
+		int64_t reach;						// Via radius plus clearance, quantized like the point
+
+		bool operator==(const Key& k) const {
+			return x == k.x && y == k.y && layer1 == k.layer1 && layer2 == k.layer2 && netId == k.netId && reach == k.reach;
+		}
+	};
+	struct KeyHash {
+		size_t operator()(const Key& k) const {
+			uint64_t h = 1469598103934665603ull;
+			auto mix = [&h](uint64_t v) { h = (h ^ v) * 1099511628211ull; };
+			mix((uint64_t)k.x);
+			mix((uint64_t)k.y);
+			mix(((uint64_t)(uint32_t)k.layer1 << 32) | (uint32_t)k.layer2);
+			mix(((uint64_t)(uint32_t)k.netId << 32) ^ (uint64_t)k.reach);
+			return (size_t)(h ^ (h >> 29));
+		}
+	};
+
+	explicit CongestionField(size_t capacity = 1 << 18) : m_capacity(capacity) {}
+
+	// Drop every sample, tiles of tileSize from now on
+	void reset(double tileSize) {
+		m_tiles.clear();
+		m_size = 0;
+		m_maxReach = 0;
+		m_tileSize = tileSize > 0 ? tileSize : 1;
+	}
+
+	static Key makeKey(const Point& pos, int layer1, int layer2, int netId, double reach) {
+		return { quantize(pos.x), quantize(pos.y), layer1, layer2, netId, quantize(reach) };
+	}
+
+	bool find(const Key& key, int& count) const {
+		auto tile = m_tiles.find(tileOf(key));
+		if (tile == m_tiles.end())
+			return false;
+		auto it = tile->second.find(key);
+		if (it == tile->second.end())
+			return false;
+		count = it->second;
+		return true;
+	}
+	void store(const Key& key, int count, double reach) {
+		if (m_size >= m_capacity) {
+			m_tiles.clear();
+			m_size = 0;
+		}
+		if (m_tiles[tileOf(key)].emplace(key, count).second)
+			++m_size;
+		m_maxReach = std::max(m_maxReach, reach);
+	}
+	// A pad with bounding box box was added or removed, samples that may count its edges are dropped
+	void padChanged(const Box& box) {
+		if (m_tiles.empty()) return;
+		int64_t tx0 = tileCoord(box[0] - m_maxReach), ty0 = tileCoord(box[1] - m_maxReach);
+		int64_t tx1 = tileCoord(box[2] + m_maxReach), ty1 = tileCoord(box[3] + m_maxReach);
+		for (int64_t tx = tx0; tx <= tx1; ++tx) {
+			for (int64_t ty = ty0; ty <= ty1; ++ty) {
+				auto tile = m_tiles.find(tileId(tx, ty));
+				if (tile == m_tiles.end()) continue;
+				m_size -= tile->second.size();
+				m_tiles.erase(tile);
+			}
+		}
+	}
+	size_t size() const { return m_size; }
+
+private:
+	using Tile = std::unordered_map<Key, int, KeyHash>;
+
+	static constexpr double m_quantum = 0.0001;		// Point::minNumber, points closer than this compare equal
+	static int64_t quantize(double v) { return (int64_t)std::llround(v / m_quantum); }
+
+	int64_t tileCoord(double v) const { return (int64_t)std::floor(v / m_tileSize); }
+	static uint64_t tileId(int64_t tx, int64_t ty) { return ((uint64_t)(uint32_t)tx << 32) | (uint32_t)ty; }
+	uint64_t tileOf(const Key& key) const { return tileId(tileCoord(key.x * m_quantum), tileCoord(key.y * m_quantum)); }
+
+	size_t m_capacity;
+	size_t m_size = 0;
+	double m_tileSize = 1;
+	double m_maxReach = 0;
+	std::unordered_map<uint64_t, Tile> m_tiles;
+};
@@ -0,0 +1,390 @@
+#include "DsnLoader.h"
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+
+using namespace std;
+
+namespace {
+	// Split a DSN line into words, parentheses act as separators: "(pin p0e15 0e15 44.5 119.92)" -> pin p0e15 0e15 44.5 119.92
+	void splitWords(const string& line, vector<string>& words) {
+		words.clear();
+		string word;
+		for (char ch : line) {
+			if (ch == '(' || ch == ')' || ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
+				if (!word.empty()) {
+					words.emplace_back(word);
+					word.clear();
+				}
+			}
+			else
+				word.push_back(ch);
+		}
+		if (!word.empty())
+			words.emplace_back(word);
+	}
+	bool toDouble(const string& s, double& value) {
+		if (s.empty()) return false;
+		char* end = nullptr;
+		value = strtod(s.c_str(), &end);
+		return end == s.c_str() + s.size();
+	}
+	string trimmed(const string& s) {
+		size_t b = s.find_first_not_of(" \t\r\n");
+		if (b == string::npos) return "";
+		size_t e = s.find_last_not_of(" \t\r\n");
+		return s.substr(b, e - b + 1);
+	}
+}
+
+bool DsnLoader::readFile(const string& fullName, DsnBoard& board) {
+	clear();
+	ifstream file(fullName);
+	if (!file.is_open()) {
+		cerr << "Error: cannot open dsn file: " << fullName << endl;
+		return false;
+	}
+	vector<string> lines;
+	string rawLine;
+	int type = -1;
+	while (getline(file, rawLine)) {
+		string line = trimmed(rawLine);
+		if (line.empty() || startsWith(line, "#") || startsWith(line, "//"))
+			continue;	// Skip empty lines and comment lines
+		// Determine which data module we are currently in based on keywords (same modules as DataParser_dsn)
+		int newType = 0;
+		if (startsWith(line, "(PCB") || startsWith(line, "(parser"))
+			newType = 1;
+		else if (startsWith(line, "(resolution"))
+			newType = 2;
+		else if (startsWith(line, "(structure"))
+			newType = 3;
+		else if (startsWith(line, "(placement"))
+			newType = 4;
+		else if (startsWith(line, "(library"))
+			newType = 5;
+		else if (startsWith(line, "(network"))
+			newType = 6;
+		else if (startsWith(line, "(wiring"))
+			newType = 7;
+		if (newType > 0) {
+			parseDSNData(lines, type);
+			type = newType;
+			lines.clear();
+		}
+		lines.emplace_back(line);
+	}
+	parseDSNData(lines, type);
+	file.close();
+
+	if (m_boundary.size() < 5) {
+		cerr << "Error: dsn file has no boundary: " << fullName << endl;
+		return false;
+	}
+	fillBoard(board);
+	return true;
+}
+
+void DsnLoader::clear() {
+	m_boundary.clear();
+	m_vias.clear();
+	m_layerNameToId.clear();
+	m_padStacks.clear();
+	m_pins.clear();
+	m_pinPads.clear();
+	m_nets.clear();
+	m_netsOrder.clear();
+	m_resolution = 100;
+}
+
+void DsnLoader::parseDSNData(vector<string>& lines, int type) {
+	switch (type) {
+	case 2: parseDSNResolution(lines); break;
+	case 3: parseDSNStructure(lines); break;
+	case 5: parseDSNLibrary(lines); break;
+	case 6: parseDSNNetwork(lines); break;
+	default: break;		// Header, placement and existing wiring are not used by the router
+	}
+}
+void DsnLoader::parseDSNResolution(vector<string>& lines) {
+	vector<string> words;
+	for (const string& line : lines) {
+		splitWords(line, words);
+		double value = 0;
+		if (words.size() >= 3 && words[0] == "resolution" && toDouble(words[2], value)) {
+			m_resolution = value;
+			break;
+		}
+	}
+}
+void DsnLoader::parseDSNStructure(vector<string>& lines) {
+	int lineCount = (int)lines.size();
+	vector<string> words;
+	for (int i = 1; i < lineCount; ++i) {
+		const string& line = lines[i];
+		if (startsWith(line, "(boundary"))
+			extractAllNumbers(m_boundary, line);
+		else if (startsWith(line, "(via")) {
+			splitWords(line, words);
+			for (size_t k = 1; k < words.size(); ++k)
+				m_vias.emplace_back(words[k]);
+		}
+		else if (startsWith(line, "(layer"))
+			parse_struc_layer(lines, i);
+	}
+}
+void DsnLoader::parseDSNLibrary(vector<string>& lines) {
+	int lineCount = (int)lines.size();
+	for (int i = 1; i < lineCount; ++i) {
+		const string& line = lines[i];
+		if (startsWith(line, "(image"))
+			parse_lib_pin(lines, i);
+		else if (startsWith(line, "(padstack"))
+			parse_lib_pad(lines, i);
+	}
+}
+void DsnLoader::parseDSNNetwork(vector<string>& lines) {
+	int lineCount = (int)lines.size();
+	for (int i = 1; i < lineCount; ++i) {
+		const string& line = lines[i];
+		if (startsWith(line, "(net"))
+			parse_network_net(lines, i);
+		else if (startsWith(line, "(class"))
+			parse_network_class(lines, i);
+	}
+}
+void DsnLoader::parse_struc_layer(vector<string>& lines, int& i) {
+	vector<string> words;
+	splitWords(lines[i], words);
+	if (words.size() < 2) return;
+	const string layerName = words[1];
+	int bracketCount = 0;
+	updateBracketCount(lines[i], bracketCount);
+	int lineCount = (int)lines.size();
+	while (bracketCount > 0 && i + 1 < lineCount) {
+		const string& line = lines[++i];
+		updateBracketCount(line, bracketCount);
+		splitWords(line, words);
+		if (words.size() >= 2 && words[0] == "type") {
+			if (!m_layerNameToId.contains(layerName))
+				m_layerNameToId[layerName] = (int)m_layerNameToId.size() + 1;
+		}
+	}
+	if (!m_layerNameToId.contains(layerName))
+		m_layerNameToId[layerName] = (int)m_layerNameToId.size() + 1;
+}
+void DsnLoader::parse_lib_pin(vector<string>& lines, int& i) {
+	int bracketCount = 0;
+	updateBracketCount(lines[i], bracketCount);
+	int lineCount = (int)lines.size();
+	vector<string> words;
+	while (bracketCount > 0 && i + 1 < lineCount) {
+		const string& line = lines[++i];
+		updateBracketCount(line, bracketCount);
+		if (!startsWith(line, "(pin")) continue;
+		// (pin padName pinName x y), pins with rotation or other attributes are not supported
+		splitWords(line, words);
+		double x = 0, y = 0;
+		if (words.size() != 5 || !toDouble(words[3], x) || !toDouble(words[4], y))
+			continue;
+		const string& padName = words[1];
+		const string& pinName = words[2];
+		m_pinPads[pinName] = padName;
+		m_pins[pinName] = Point(x, y);
+	}
+}
+void DsnLoader::parse_lib_pad(vector<string>& lines, int& i) {
+	vector<string> words;
+	splitWords(lines[i], words);
+	if (words.size() < 2) return;
+	vector<DsnShape>& shapes = m_padStacks[words[1]];
+	int bracketCount = 0;
+	updateBracketCount(lines[i], bracketCount);
+	int lineCount = (int)lines.size();
+	while (bracketCount > 0 && i + 1 < lineCount) {
+		const string& line = lines[++i];
+		updateBracketCount(line, bracketCount);
+		if (!startsWith(line, "(shape(")) continue;
+		// (shape(type layerName values...))
+		splitWords(line, words);
+		if (words.size() < 3) continue;
+		DsnShape shape;
+		shape.shapeType = words[1];
+		auto layerIt = m_layerNameToId.find(words[2]);
+		if (layerIt == m_layerNameToId.end()) {
+			cout << "Invalid layer name: " << words[2] << endl;
+			continue;
+		}
+		shape.layer = layerIt->second;
+		vector<double> values;
+		for (size_t k = 3; k < words.size(); ++k) {
+			double v = 0;
+			if (toDouble(words[k], v))
+				values.emplace_back(v);
+		}
+		if (shape.shapeType == "polygon") {
+			// values[0] is the aperture width, followed by vertex coordinates
+			for (size_t k = 1; k + 1 < values.size(); k += 2)
+				shape.pts.emplace_back(values[k], values[k + 1]);
+		}
+		else if (shape.shapeType == "circle") {
+			if (values.empty()) continue;
+			shape.radius = values[0] / 2.0;		// Convert diameter to radius
+			if (values.size() >= 3)
+				shape.center = Point(values[1], values[2]);
+		}
+		shapes.emplace_back(shape);
+	}
+}
+void DsnLoader::parse_network_net(vector<string>& lines, int& i) {
+	vector<string> words;
+	splitWords(lines[i], words);
+	if (words.size() < 2) return;
+	const string netName = words[1];
+	if (!m_nets.contains(netName))
+		m_netsOrder.emplace_back(netName);
+	DsnNet& newNet = m_nets[netName];
+	int bracketCount = 0;
+	updateBracketCount(lines[i], bracketCount);
+	int lineCount = (int)lines.size();
+	while (bracketCount > 0 && i + 1 < lineCount) {
+		const string& line = lines[++i];
+		updateBracketCount(line, bracketCount);
+		if (!startsWith(line, "(pins")) continue;
+		// (pins component-pinName ...)
+		splitWords(line, words);
+		for (size_t k = 1; k < words.size(); ++k) {
+			size_t pos = words[k].find('-');
+			if (pos != string::npos && pos + 1 < words[k].size())
+				newNet.pinsNames.emplace_back(words[k].substr(pos + 1));
+		}
+	}
+}
+void DsnLoader::parse_network_class(vector<string>& lines, int& i) {
+	vector<string> words;
+	splitWords(lines[i], words);
+	if (words.size() < 2 || words[1].front() == '\'') return;
+	const string netName = words[1];
+	if (!m_nets.contains(netName))
+		m_netsOrder.emplace_back(netName);
+	DsnNet& readNet = m_nets[netName];
+	int bracketCount = 0;
+	updateBracketCount(lines[i], bracketCount);
+	int lineCount = (int)lines.size();
+	while (bracketCount > 0 && i + 1 < lineCount) {
+		const string& line = lines[++i];
+		updateBracketCount(line, bracketCount);
+		splitWords(line, words);
+		// (circuit(use_via via0)), (width 1), (clearance 0.4)
+		for (size_t k = 0; k + 1 < words.size(); ++k) {
+			double value = 0;
+			if (words[k] == "use_via")
+				readNet.via = words[k + 1];
+			else if (words[k] == "width" && toDouble(words[k + 1], value))
+				readNet.width = value;
+			else if (words[k] == "clearance" && toDouble(words[k + 1], value))
+				readNet.clearance = value;
+		}
+	}
+}
+
+void DsnLoader::fillBoard(DsnBoard& board) {
+	board.resolution = m_resolution;
+	board.layers.clear();
+	board.viaInfos.clear();
+	board.pads.clear();
+	board.nets.clear();
+	board.netsInfos.clear();
+	for (const auto& [layerName, layerId] : m_layerNameToId)
+		board.layers[layerId] = layerName;
+	// 1. Set boundaries (the first number of the boundary path is its width)
+	double minX = m_boundary[1], minY = m_boundary[2];
+	double maxX = minX, maxY = minY;
+	for (size_t i = 3; i + 1 < m_boundary.size(); i += 2) {
+		minX = min(minX, m_boundary[i]);
+		maxX = max(maxX, m_boundary[i]);
+		minY = min(minY, m_boundary[i + 1]);
+		maxY = max(maxY, m_boundary[i + 1]);
+	}
+	board.bound = { minX, minY, maxX, maxY };
+	// 2. Fill viaInfos
+	for (const string& viaName : m_vias) {
+		auto it = m_padStacks.find(viaName);
+		if (it == m_padStacks.end() || it->second.empty()) continue;
+		vector<int> layers;
+		for (const DsnShape& shape : it->second)
+			layers.emplace_back(shape.layer);
+		board.viaInfos[viaName] = ViaInfo(it->second[0].radius, layers);
+	}
+	// 3. Fill pads
+	for (const auto& [pinName, pinPos] : m_pins) {
+		// 3.1 Set pad coordinates
+		board.pads.insert(make_pair(pinName, PinPad(pinPos, pinName, "", 0.5)));
+		PinPad& onePad = board.pads[pinName];
+		// 3.2 Set pad polygon
+		auto padIt = m_pinPads.find(pinName);
+		if (padIt == m_pinPads.end()) continue;
+		auto shapesIt = m_padStacks.find(padIt->second);
+		if (shapesIt == m_padStacks.end()) continue;
+		const vector<DsnShape>& shapes = shapesIt->second;
+		if (shapes.empty()) {
+			cout << "shapes is empty:" << padIt->second << endl;
+			continue;
+		}
+		// 3.3 Process the shape of the first shape first, others are the same as the first
+		const DsnShape& shape0 = shapes[0];
+		vector<Line> edges;
+		if (shape0.shapeType == "polygon") {
+			size_t pointCount = shape0.pts.size();
+			bool isClosed = (pointCount > 1 && shape0.pts[0].x == shape0.pts[pointCount - 1].x && shape0.pts[0].y == shape0.pts[pointCount - 1].y);
+			size_t effectivePointCount = isClosed ? pointCount - 1 : pointCount;
+			if (effectivePointCount < 2) continue;
+			for (size_t i = 0; i < effectivePointCount; ++i) {
+				size_t next_i = (i + 1) % effectivePointCount;
+				Point p1 = shape0.pts[i] + pinPos;
+				Point p2 = shape0.pts[next_i] + pinPos;
+				if (p1.x == p2.x && p1.y == p2.y)
+					continue;
+				edges.emplace_back(Line(p1, p2));
+			}
+			// 3.4 Each shape has the same shape but different layer
+			for (const DsnShape& shape : shapes)
+				onePad.addShape(shape.layer, edges);
+		}
+		else if (shape0.shapeType == "circle" && shape0.radius > 0) {
+			for (const DsnShape& shape : shapes)
+				onePad.addShape(shape.layer, shape.radius, shape.center);
+		}
+	}
+	// 4. Fill nets and net constraint information
+	for (const string& netName : m_netsOrder) {
+		const DsnNet& net = m_nets[netName];
+		vector<PinPad*> oneNet;
+		for (const string& pinName : net.pinsNames) {
+			PinPad* pad = &board.pads[pinName];
+			pad->setNetName(netName);
+			oneNet.emplace_back(pad);
+		}
+		board.nets[netName] = oneNet;
+		board.netsInfos[netName] = NetInfo(net.via, net.width, net.clearance);
+	}
+}
+
+void DsnLoader::updateBracketCount(const string& line, int& bracketCount) {
+	for (char ch : line) {
+		if (ch == '(') ++bracketCount;
+		else if (ch == ')') --bracketCount;
+	}
+}
+void DsnLoader::extractAllNumbers(vector<double>& out, const string& s) {
+	vector<string> words;
+	splitWords(s, words);
+	for (const string& word : words) {
+		double value = 0;
+		if (toDouble(word, value))
+			out.push_back(value);
+	}
+}
+bool DsnLoader::startsWith(const string& line, const char* prefix) {
+	return line.rfind(prefix, 0) == 0;
+}
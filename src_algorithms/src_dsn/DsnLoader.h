@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "RoutingNode.h"
+
+// Qt-free DSN reader: fills the same algorithm input data that AlgorithmLink_dsn::dataInit builds for the GUI
+struct DsnBoard {
+	double resolution = 100;							// dsn resolution (mil)
+	vector<double> bound;								// minX, minY, maxX, maxY
+	unordered_map<int, string> layers;					// Layer ID -> layer type
+	unordered_map<string, PinPad> pads;					// pad_name(pin_name) -> pad
+	unordered_map<string, ViaInfo> viaInfos;			// via_name -> via
+	unordered_map<string, NetInfo> netsInfos;			// net_name -> Net table constraint information
+	unordered_map<string, vector<PinPad*>> nets;		// net_name -> pads of the net
+};
+
+class DsnLoader {
+public:
+	DsnLoader() {};
+
+	bool readFile(const string& fullName, DsnBoard& board);
+
+private:
+	struct DsnShape {
+		string shapeType;			// circle, polygon
+		int layer = 1;
+		vector<Point> pts;			// Polygon vertices (relative to pin)
+		Point center;				// Circle center (relative to pin)
+		double radius = 0;
+	};
+	struct DsnNet {
+		vector<string> pinsNames;
+		string via = "via0";		// Default via (optional)
+		double width = 1;			// Line width (optional)
+		double clearance = 0.4;		// Clearance (optional)
+	};
+
+	// Raw data read from the file
+	vector<double> m_boundary;
+	vector<string> m_vias;
+	unordered_map<string, int> m_layerNameToId;
+	unordered_map<string, vector<DsnShape>> m_padStacks;	// Pad name -> shapes
+	unordered_map<string, Point> m_pins;					// Pin name -> position
+	unordered_map<string, string> m_pinPads;				// Pin name -> pad name
+	unordered_map<string, DsnNet> m_nets;
+	vector<string> m_netsOrder;
+	double m_resolution = 100;
+
+	void clear();
+	void parseDSNData(vector<string>& lines, int type);
+	void parseDSNResolution(vector<string>& lines);
+	void parseDSNStructure(vector<string>& lines);
+	void parseDSNLibrary(vector<string>& lines);
+	void parseDSNNetwork(vector<string>& lines);
+
+	void parse_struc_layer(vector<string>& lines, int& i);
+	void parse_lib_pin(vector<string>& lines, int& i);
+	void parse_lib_pad(vector<string>& lines, int& i);
+	void parse_network_net(vector<string>& lines, int& i);
+	void parse_network_class(vector<string>& lines, int& i);
+
+	void fillBoard(DsnBoard& board);
+
+	static void updateBracketCount(const string& line, int& bracketCount);
+	static void extractAllNumbers(vector<double>& out, const string& s);
+	static bool startsWith(const string& line, const char* prefix);
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+
+#include "RoutingNode.h"
+
+// Expanded nodes of one search tree, bucketed per layer on a square grid
+// The closest nodes to a point are gathered ring by ring around its bucket, a ring r + 1 is only scanned while it can
+// still hold a node closer than the ones found, nodes in it are at least r cells away
+class ExpandedNodeGrid {
+public:
+	void reset(double cellSize) {
+		m_layers.clear();
+		m_used.clear();
+		m_cellSize = cellSize > 0 ? cellSize : 1;
+	}
+	// Empties the buckets but keeps them allocated for the next search
+	void clear() {
+		for (std::vector<PathTree*>* bucket : m_used)
+			bucket->clear();
+		m_used.clear();
+		for (auto& [layer, table] : m_layers)
+			table.size = 0;
+	}
+	void insert(PathTree* node) {
+		Layer& table = m_layers[node->layer];
+		int64_t cx = cellCoord(node->pos.x), cy = cellCoord(node->pos.y);
+		if (table.size == 0) {
+			table.minX = table.maxX = cx;
+			table.minY = table.maxY = cy;
+		}
+		else {
+			table.minX = std::min(table.minX, cx);
+			table.minY = std::min(table.minY, cy);
+			table.maxX = std::max(table.maxX, cx);
+			table.maxY = std::max(table.maxY, cy);
+		}
+		std::vector<PathTree*>& bucket = table.buckets[cellId(cx, cy)];
+		if (bucket.empty())
+			m_used.push_back(&bucket);
+		bucket.push_back(node);
+		++table.size;
+	}
+	// The count nodes on layer closest to pos, nearest first (out holds the distance and the node)
+	void nearest(const Point& pos, int layer, size_t count, std::vector<std::pair<double, PathTree*>>& out) const {
+		out.clear();
+		auto it = m_layers.find(layer);
+		if (it == m_layers.end() || it->second.size == 0 || count == 0)
+			return;
+		const Layer& table = it->second;
+		int64_t cx = cellCoord(pos.x), cy = cellCoord(pos.y);
+		int64_t maxRing = std::max(std::max(cx - table.minX, table.maxX - cx), std::max(cy - table.minY, table.maxY - cy));
+		auto byDistance = [](const auto& a, const auto& b) { return a.first < b.first; };
+		auto visit = [&](int64_t x, int64_t y) {
+			if (x < table.minX || x > table.maxX || y < table.minY || y > table.maxY) return;
+			auto bucket = table.buckets.find(cellId(x, y));
+			if (bucket == table.buckets.end()) return;
+			for (PathTree* node : bucket->second)
+				out.emplace_back(pos.distanceTo(node->pos), node);
+		};
+		for (int64_t r = 0; r <= maxRing; ++r) {
+			for (int64_t x = cx - r; x <= cx + r; ++x) {
+				visit(x, cy - r);
+				if (r > 0) visit(x, cy + r);
+			}
+			for (int64_t y = cy - r + 1; y <= cy + r - 1; ++y) {
+				visit(cx - r, y);
+				visit(cx + r, y);
+			}
+			if (out.size() < count) continue;
+			std::partial_sort(out.begin(), out.begin() + count, out.end(), byDistance);
+			if (out[count - 1].first <= r * m_cellSize)
+				break;
+		}
+		size_t found = std::min(out.size(), count);
+		std::partial_sort(out.begin(), out.begin() + found, out.end(), byDistance);
+		out.resize(found);
+	}
+
+private:
+	struct Layer {
+		std::unordered_map<uint64_t, std::vector<PathTree*>> buckets;
+		int64_t minX = 0, minY = 0, maxX = 0, maxY = 0;		// Bucket range holding nodes of the current search
+		size_t size = 0;
+	};
+	std::unordered_map<int, Layer> m_layers;
+	std::vector<std::vector<PathTree*>*> m_used;	// Buckets filled since the last clear
+	double m_cellSize = 1;
+
+	int64_t cellCoord(double v) const { return (int64_t)std::floor(v / m_cellSize); }
+	static uint64_t cellId(int64_t cx, int64_t cy) { return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy; }
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+#include "RoutingNode.h"
+
+// Explored search nodes of one pin-pair search: (quantized x, quantized y, layer) -> PathTree*
+// Flat open-addressing table with linear probing; slots written in an older generation count as empty,
+// so clear() between searches only bumps the generation
+class ExploredNodeTable {
+public:
+	explicit ExploredNodeTable(size_t initialCapacity = 1024) {
+		size_t capacity = 16;
+		while (capacity < initialCapacity)
+			capacity <<= 1;
+		m_slots.resize(capacity);
+		m_mask = capacity - 1;
+	}
+
+	PathTree* find(const Point& pos, int layer) const {
+		int64_t qx = quantize(pos.x), qy = quantize(pos.y);
+		for (size_t i = slotIndex(qx, qy, layer);; i = (i + 1) & m_mask) {
+			const Slot& slot = m_slots[i];
+			if (slot.generation != m_generation)
+				return nullptr;
+			if (slot.x == qx && slot.y == qy && slot.layer == layer)
+				return slot.node;
+		}
+	}
+	// Keeps the existing node if the position is already explored on this layer
+	void insert(const Point& pos, int layer, PathTree* node) {
+		if ((m_size + 1) * 4 > m_slots.size() * 3)
+			grow();
+		place(quantize(pos.x), quantize(pos.y), layer, node);
+	}
+	void clear() {
+		m_size = 0;
+		if (++m_generation == 0) {		// Wrapped, old stamps could look current again
+			for (Slot& slot : m_slots)
+				slot.generation = 0;
+			m_generation = 1;
+		}
+	}
+	size_t size() const { return m_size; }
+
+private:
+	struct Slot {
+		int64_t x = 0;
+		int64_t y = 0;
+		int32_t layer = 0;
+		uint32_t generation = 0;
+		PathTree* node = nullptr;
+	};
+
+	std::vector<Slot> m_slots;
+	size_t m_mask = 0;
+	size_t m_size = 0;
+	uint32_t m_generation = 1;
+
+	// Same quantum as Point::Hash, points closer than Point::minNumber share a key
+	static int64_t quantize(double v) { return (int64_t)std::llround(v / 0.0001); }
+	size_t slotIndex(int64_t qx, int64_t qy, int layer) const {
+		uint64_t h = (uint64_t)qx * 0x9E3779B97F4A7C15ull;
+		h ^= (uint64_t)qy * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+		h ^= (uint64_t)(uint32_t)layer * 0x165667B19E3779F9ull;
+		h ^= h >> 31;
+		return (size_t)h & m_mask;
+	}
+	void place(int64_t qx, int64_t qy, int layer, PathTree* node) {
+		for (size_t i = slotIndex(qx, qy, layer);; i = (i + 1) & m_mask) {
+			Slot& slot = m_slots[i];
+			if (slot.generation != m_generation) {
+				slot = { qx, qy, layer, m_generation, node };
+				++m_size;
+				return;
+			}
+			if (slot.x == qx && slot.y == qy && slot.layer == layer)
+				return;
+		}
+	}
+	void grow() {
+		std::vector<Slot> old;
+		old.swap(m_slots);
+		m_slots.resize(old.size() * 2);
+		m_mask = m_slots.size() - 1;
+		uint32_t generation = m_generation;
+		m_generation = 1;
+		m_size = 0;
+		for (const Slot& slot : old) {
+			if (slot.generation == generation)
+				place(slot.x, slot.y, slot.layer, slot.node);
+		}
+	}
+};
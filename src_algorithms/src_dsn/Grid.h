@@ -4,9 +4,130 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <functional>
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include <array>
 
 #include "RoutingNode.h"  // Include PathNode and other related definitions
+#include "SegmentBatch.h"
+
+// Clip the parameter range [t0, t1] of f(t) = f1 + t * df to lo <= f <= hi
+inline bool clipSlab(double f1, double df, double lo, double hi, double& t0, double& t1) {
+	if (std::abs(df) < 1e-12)
+		return f1 >= lo && f1 <= hi;
+	double ta = (lo - f1) / df;
+	double tb = (hi - f1) / df;
+	if (ta > tb) std::swap(ta, tb);
+	t0 = std::max(t0, ta);
+	t1 = std::min(t1, tb);
+	return t0 <= t1;
+}
+// Does segment p1p2 touch the octagon ext (minX, minY, maxX, maxY, min(x+y), min(x-y), max(x+y), max(x-y)) grown by inflate
+// The grown octagon contains every point within inflate of the hull, so a miss means the obstacle is farther than inflate
+inline bool segmentHitsOctagon(const Vec2& p1, const Vec2& p2, const double* ext, double inflate) {
+	inflate += MapMinValue;
+	double diagInflate = inflate * 1.41421356237;
+	double t0 = 0, t1 = 1;
+	return clipSlab(p1.x, p2.x - p1.x, ext[0] - inflate, ext[2] + inflate, t0, t1) &&
+		clipSlab(p1.y, p2.y - p1.y, ext[1] - inflate, ext[3] + inflate, t0, t1) &&
+		clipSlab(p1.x + p1.y, (p2.x + p2.y) - (p1.x + p1.y), ext[4] - diagInflate, ext[6] + diagInflate, t0, t1) &&
+		clipSlab(p1.x - p1.y, (p2.x - p2.y) - (p1.x - p1.y), ext[5] - diagInflate, ext[7] + diagInflate, t0, t1);
+}
+
+// Compact trace record stored contiguously in a cell
+// Endpoints are copied at insertion, paths are always removed from the grid before their nodes are moved
+struct GridSegment {
+	Vec2 p1, p2;
+	double halfWidth = 0;
+	int layer = 0;
+	int netId = -1;
+	int pathId = -1;				// Dense id of the owner path, for deduplication in ObstacleQuery
+	double clearance = 0;			// Clearance of the owner path, copied so snapshots never read the path
+	PathLine* line = nullptr;		// Owner edge
+	PolyShape* shape = nullptr;		// Owner path
+
+	// Conservative blocking test: false if segment p1p2 keeps more than clearance from this trace's edge
+	bool mayBlock(const Vec2& q1, const Vec2& q2, double clearance) const {
+		double ext[8] = { std::min(p1.x, p2.x), std::min(p1.y, p2.y), std::max(p1.x, p2.x), std::max(p1.y, p2.y),
+			std::min(p1.x + p1.y, p2.x + p2.y), std::min(p1.x - p1.y, p2.x - p2.y),
+			std::max(p1.x + p1.y, p2.x + p2.y), std::max(p1.x - p1.y, p2.x - p2.y) };
+		return segmentHitsOctagon(q1, q2, ext, halfWidth + clearance);
+	}
+};
+
+// Outline of a pad on one layer as it was when the pad entered the index
+struct PadOutline {
+	int layer = 0;
+	double clearance = 0;
+	PolyShape* shape = nullptr;		// Owner shape, only compared and handed to the result policies
+	std::vector<Segment> edges;
+};
+
+// Compact pad record stored contiguously in a cell
+struct GridPad {
+	double box[4] = { 0, 0, 0, 0 };	// minX, minY, maxX, maxY
+	double hull[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };	// Octagon around the vertices of all shapes, see segmentHitsOctagon
+	uint64_t layerMask = 0;				// Bit i is set if the pad has a shape on layer i
+	int netId = -1;
+	int padId = -1;					// Dense id of the pad, for deduplication in ObstacleQuery
+	PinPad* pad = nullptr;
+	std::shared_ptr<const std::vector<PadOutline>> outlines;	// Shared by every cell and snapshot holding the pad
+
+	bool onLayer(int layer) const {
+		return layer >= 0 && layer < 64 && ((layerMask >> layer) & 1);
+	}
+	// Conservative blocking test: false if segment p1p2 keeps more than inflate from every shape of the pad
+	// (inflate is the half line width plus clearance of the rule class being routed)
+	bool mayBlock(const Vec2& p1, const Vec2& p2, double inflate) const {
+		return segmentHitsOctagon(p1, p2, hull, inflate);
+	}
+	// Outline on layer, nullptr if the pad has no shape there
+	const PadOutline* outline(int layer) const {
+		for (const PadOutline& o : *outlines) {
+			if (o.layer == layer)
+				return &o;
+		}
+		return nullptr;
+	}
+	// Lowest layer in [layer1, layer2] the pad has a shape on, -1 if none
+	int lowestLayerIn(int layer1, int layer2) const {
+		for (int layer = std::max(layer1, 0); layer <= layer2 && layer < 64; ++layer) {
+			if ((layerMask >> layer) & 1)
+				return layer;
+		}
+		return -1;
+	}
+};
+
+// Axis-aligned box overlap, boxes are minX, minY, maxX, maxY
+inline bool boxOverlap(const double* a, const double* b) {
+	return a[0] <= b[2] && a[2] >= b[0] && a[1] <= b[3] && a[3] >= b[1];
+}
+// Liang-Barsky clipping of segment p1p2 against the box grown by inflate
+inline bool segmentHitsBox(const Vec2& p1, const Vec2& p2, const double* box, double inflate) {
+	inflate += MapMinValue;
+	double dx = p2.x - p1.x;
+	double dy = p2.y - p1.y;
+	double p[4] = { -dx, dx, -dy, dy };
+	double q[4] = { p1.x - (box[0] - inflate), (box[2] + inflate) - p1.x, p1.y - (box[1] - inflate), (box[3] + inflate) - p1.y };
+	double t0 = 0, t1 = 1;
+	for (int i = 0; i < 4; ++i) {
+		if (std::abs(p[i]) < 1e-12) {
+			if (q[i] < 0) return false;		// Parallel and outside
+		}
+		else {
+			double t = q[i] / p[i];
+			if (p[i] < 0) t0 = std::max(t0, t);
+			else t1 = std::min(t1, t);
+			if (t0 > t1) return false;
+		}
+	}
+	return true;
+}
 
 // Grid cell class
 
@@ -19,6 +140,11 @@ public:
 		m_bbox[2] = (x + 1) * cellSize; // maxX
 		m_bbox[3] = (y + 1) * cellSize; // maxY
 	}
+	// Cell with an explicit boundary (quadtree leaves)
+	GridCell(double minX, double minY, double maxX, double maxY)
+		: m_x(-1), m_y(-1), m_cellSize(maxX - minX) {
+		m_bbox = { minX, minY, maxX, maxY };
+	}
 
 	// Check if a point is inside the grid
 	bool contains(const Point& point) const {
@@ -82,37 +208,67 @@ public:
 	}
 
 	// Add shape to grid
-	void addPathLines(PathLine* line, PolyShape* shape) {
-		m_pathLines.insert(make_pair(line, shape));
+	// Add/remove functions return the number of records added or removed (for occupancy counts)
+	int addPathLines(const GridSegment& segment) {
+		for (const GridSegment& seg : m_pathLines) {
+			if (seg.line == segment.line) return 0;
+		}
+		m_pathLines.emplace_back(segment);
+		return 1;
 	}
-	void removePathLines(PathLine* line) {
-		m_pathLines.erase(line);
+	// Swap-remove, the order of records in a cell is not meaningful
+	int removeShapeLines(const PolyShape* shape) {
+		int removed = 0;
+		for (size_t i = 0; i < m_pathLines.size();) {
+			if (m_pathLines[i].shape == shape) {
+				m_pathLines[i] = m_pathLines.back();
+				m_pathLines.pop_back();
+				++removed;
+			}
+			else
+				++i;
+		}
+		return removed;
 	}
-	void clearAllPathLines() {
+	int clearAllPathLines() {
+		int removed = (int)m_pathLines.size();
 		m_pathLines.clear();
+		return removed;
 	}
-	// Add PinPad to grid (add all its shapes)
-	void addPinPad(PinPad* pad) {
-		m_pinPads.insert(pad);
+	// Add PinPad to grid
+	int addPinPad(const GridPad& gridPad) {
+		for (const GridPad& gp : m_pinPads) {
+			if (gp.pad == gridPad.pad) return 0;
+		}
+		m_pinPads.emplace_back(gridPad);
+		return 1;
 	}
-	void removePinPad(PinPad* pad) {
-		m_pinPads.erase(pad);
+	int removePinPad(PinPad* pad) {
+		for (size_t i = 0; i < m_pinPads.size(); ++i) {
+			if (m_pinPads[i].pad == pad) {
+				m_pinPads[i] = m_pinPads.back();
+				m_pinPads.pop_back();
+				return 1;
+			}
+		}
+		return 0;
 	}
 
 	// Get all shapes in the grid
-	const std::unordered_map<PathLine*, PolyShape*>& getPathLines() {
+	const std::vector<GridSegment>& getPathLines() const {
 		return m_pathLines;
 	}
-	const std::unordered_set<PinPad*>& getPinPads() {
+	const std::vector<GridPad>& getPinPads() const {
 		return m_pinPads;
 	}
 	// Get grid boundary
-	const std::vector<double>& getBBox() const {
+	const Box& getBBox() const {
 		return m_bbox;
 	}
 
 	int getX() const { return m_x; }
 	int getY() const { return m_y; }
+	int recordCount() const { return (int)(m_pathLines.size() + m_pinPads.size()); }
 
 private:
 	// Compute the bounding box of a shape
@@ -149,190 +305,571 @@ private:
 private:
 	int m_x, m_y;
 	double m_cellSize;
-	std::vector<double> m_bbox = { 0, 0, 0, 0 }; // minX, minY, maxX, maxY
-	std::unordered_map<PathLine*, PolyShape*> m_pathLines;
-	std::unordered_set<PinPad*> m_pinPads;
+	Box m_bbox = { 0, 0, 0, 0 }; // minX, minY, maxX, maxY
+	std::vector<GridSegment> m_pathLines;
+	std::vector<GridPad> m_pinPads;
+};
+
+enum class ObstacleIndexType { Grid, QuadTree };
+
+// Spatial index of the routing obstacles (pads, vias, routed traces)
+// Queries return buckets (GridCell) holding the records near the query region on one layer;
+// a record overlapping several buckets is stored in each of them
+// Concurrency: one writer thread mutates the index, any number of reader threads query published snapshots
+// A snapshot keeps the records it was taken with, which carry their own copy of the geometry the queries read; the
+// owner pointers in them (pad, line, shape) may dangle once the router frees or moves the owner, so readers of a
+// snapshot only compare them and never dereference them
+class ObstacleIndex {
+public:
+	ObstacleIndex() {}
+	virtual ~ObstacleIndex() {}
+
+	virtual void addPinPad(PinPad* pad) = 0;
+	virtual void removePinPad(PinPad* pad) = 0;
+	virtual void addShapeLines(PolyShape* shape) = 0;
+	virtual void removeOnePath(PolyShape* shape) = 0;
+	virtual void clearAllPathLines() = 0;
+	virtual int getMaxLayer() const = 0;
+
+	// Box query
+	virtual void getCellsInBox(const Box& b, int layer, std::vector<GridCell*>& cells) const = 0;
+	// Segment corridor query, the corridor is the segment widened by width
+	virtual void getCellsAlongLine2(const Line& line, const double& width, int layer, std::vector<GridCell*>& cells) const = 0;
+	// Point-radius query
+	virtual void getCellsNearPoint(const Point& pos, double r, int layer, std::vector<GridCell*>& cells) const {
+		getCellsInBox({ pos.x - r, pos.y - r, pos.x + r, pos.y + r }, layer, cells);
+	}
+
+	// Incremented by every add/remove, a snapshot keeps the version it was taken at
+	uint64_t getVersion() const { return m_version; }
+	// Publish an immutable snapshot of the current state for reader threads, nullptr if the index does not support it
+	// Writer thread only (nothing in the router reads snapshots yet, they are for tools querying a board being routed;
+	// tests/snapshot_stress.cpp queries them from reader threads under ThreadSanitizer)
+	std::shared_ptr<const ObstacleIndex> publishSnapshot() {
+		std::shared_ptr<const ObstacleIndex> snapshot = makeSnapshot();
+		std::lock_guard<std::mutex> lock(m_snapshotMutex);
+		m_snapshot = snapshot;
+		return snapshot;
+	}
+	// Latest published snapshot, safe to call from any thread
+	std::shared_ptr<const ObstacleIndex> getSnapshot() const {
+		std::lock_guard<std::mutex> lock(m_snapshotMutex);
+		return m_snapshot;
+	}
+
+	// Net name -> compact net id used by the cell records
+	int getNetId(const std::string& netName) {
+		auto it = m_netIds.find(netName);
+		if (it != m_netIds.end())
+			return it->second;
+		int id = (int)m_netIds.size();
+		m_netIds.emplace(netName, id);
+		return id;
+	}
+	// Upper bounds of the pad and path ids stored in the records
+	int getPadIdCount() const { return (int)m_padIds.size(); }
+	int getPathIdCount() const { return (int)m_pathIds.size(); }
+	// Read-only lookup for snapshots, -1 if the net was never indexed
+	int findNetId(const std::string& netName) const {
+		auto it = m_netIds.find(netName);
+		return it != m_netIds.end() ? it->second : -1;
+	}
+
+protected:
+	// Snapshots copy the net ids and version, not the published snapshot
+	ObstacleIndex(const ObstacleIndex& other)
+		: m_netIds(other.m_netIds), m_padIds(other.m_padIds), m_pathIds(other.m_pathIds), m_version(other.m_version) {
+	}
+	virtual std::shared_ptr<const ObstacleIndex> makeSnapshot() const { return nullptr; }
+	void bumpVersion() { ++m_version; }
+
+	GridPad makeGridPad(PinPad* pad) {
+		GridPad gridPad;
+		for (int i = 0; i < 4; ++i)
+			gridPad.box[i] = pad->box[i];
+		// Octagon hull of all outlines, the box is used if the pad has none
+		double* hull = gridPad.hull;
+		hull[0] = pad->box[0];
+		hull[1] = pad->box[1];
+		hull[2] = pad->box[2];
+		hull[3] = pad->box[3];
+		hull[4] = pad->box[0] + pad->box[1];
+		hull[5] = pad->box[0] - pad->box[3];
+		hull[6] = pad->box[2] + pad->box[3];
+		hull[7] = pad->box[2] - pad->box[1];
+		bool first = true;
+		auto outlines = std::make_shared<std::vector<PadOutline>>();
+		for (auto& [layer, shape] : pad->shapes) {
+			if (layer >= 0 && layer < 64)
+				gridPad.layerMask |= uint64_t(1) << layer;
+			PadOutline& outline = outlines->emplace_back();
+			outline.layer = layer;
+			outline.clearance = shape.clearance;
+			outline.shape = &shape;
+			outline.edges.reserve(shape.edges.size());
+			for (const PathLine& e : shape.edges) {
+				outline.edges.emplace_back(e.p1->pos, e.p2->pos);
+				const Point& v = e.p1->pos;
+				double ext[8] = { v.x, v.y, v.x, v.y, v.x + v.y, v.x - v.y, v.x + v.y, v.x - v.y };
+				for (int i = 0; i < 8; ++i) {
+					if (first) hull[i] = ext[i];
+					else hull[i] = i < 2 || i == 4 || i == 5 ? std::min(hull[i], ext[i]) : std::max(hull[i], ext[i]);
+				}
+				first = false;
+			}
+		}
+		gridPad.netId = getNetId(pad->netName);
+		gridPad.padId = getDenseId(m_padIds, pad);
+		gridPad.pad = pad;
+		gridPad.outlines = std::move(outlines);
+		return gridPad;
+	}
+	GridSegment makeGridSegment(PathLine& e, PolyShape* shape) {
+		GridSegment segment;
+		segment.p1 = e.p1->pos;
+		segment.p2 = e.p2->pos;
+		segment.halfWidth = e.width / 2;
+		segment.layer = e.layer;
+		segment.netId = getNetId(e.p1->netName);
+		segment.pathId = getDenseId(m_pathIds, shape);
+		segment.clearance = shape->clearance;
+		segment.line = &e;
+		segment.shape = shape;
+		return segment;
+	}
+
+private:
+	// Ids stay valid after removal, so a re-added pad or path keeps its id
+	template <typename T>
+	static int getDenseId(std::unordered_map<const T*, int>& ids, const T* key) {
+		auto it = ids.find(key);
+		if (it != ids.end())
+			return it->second;
+		int id = (int)ids.size();
+		ids.emplace(key, id);
+		return id;
+	}
+
+	std::unordered_map<std::string, int> m_netIds;
+	std::unordered_map<const PinPad*, int> m_padIds;
+	std::unordered_map<const PolyShape*, int> m_pathIds;
+	uint64_t m_version = 0;
+	mutable std::mutex m_snapshotMutex;
+	std::shared_ptr<const ObstacleIndex> m_snapshot;
+};
+
+// Reusable scratch state of obstacle queries, one per thread (queries on a snapshot get their own)
+// Pads and paths are deduplicated by "last seen" epoch stamps instead of hash sets, and the buffers keep
+// their capacity between queries, so the collision code does not allocate in steady state
+class ObstacleQuery {
+public:
+	std::vector<GridCell*> cells;		// Cells returned by the index
+	std::vector<PolyShape*> shapes;		// Deduplicated obstacles collected by the caller
+	SegmentBatch batch;					// Obstacle edges for findBlockingEdges
+	std::vector<PolyShape*> batchShapes;	// Owner of each batch edge
+	// Fan queries gather candidates once for up to 64 lines, bit i of a mask is set if the record lies in the corridor of line i
+	struct FanCell {
+		GridCell* cell;
+		size_t order;		// First appearance, keeps the gathering order of the lines
+		uint64_t mask;
+	};
+	std::vector<FanCell> fanCells;
+	std::vector<GridCell*> lineCells;
+	std::vector<const GridPad*> candidatePads;
+	std::vector<uint64_t> padMasks;
+	std::vector<const GridSegment*> candidateTraces;
+	std::vector<uint64_t> traceMasks;
+
+	// Start a new query against index
+	void begin(const ObstacleIndex& index) {
+		cells.clear();
+		shapes.clear();
+		batch.clear();
+		batchShapes.clear();
+		fanCells.clear();
+		candidatePads.clear();
+		padMasks.clear();
+		candidateTraces.clear();
+		traceMasks.clear();
+		if (++m_epoch == 0) {
+			// Stamps wrapped around, forget them
+			std::fill(m_padStamps.begin(), m_padStamps.end(), 0);
+			std::fill(m_pathStamps.begin(), m_pathStamps.end(), 0);
+			m_epoch = 1;
+		}
+		if ((int)m_padStamps.size() < index.getPadIdCount()) {
+			m_padStamps.resize(index.getPadIdCount() * 2, 0);
+			m_padSlots.resize(m_padStamps.size(), 0);
+		}
+		if ((int)m_pathStamps.size() < index.getPathIdCount())
+			m_pathStamps.resize(index.getPathIdCount() * 2, 0);
+	}
+	// True the first time a pad (path) is seen in the current query
+	bool visitPad(int padId) {
+		if (m_padStamps[padId] == m_epoch) return false;
+		m_padStamps[padId] = m_epoch;
+		return true;
+	}
+	bool visitPath(int pathId) {
+		if (m_pathStamps[pathId] == m_epoch) return false;
+		m_pathStamps[pathId] = m_epoch;
+		return true;
+	}
+	// visitPad that also remembers a slot: stored on the first visit, handed back on later ones
+	bool visitPad(int padId, uint32_t& slot) {
+		if (m_padStamps[padId] == m_epoch) {
+			slot = m_padSlots[padId];
+			return false;
+		}
+		m_padStamps[padId] = m_epoch;
+		m_padSlots[padId] = slot;
+		return true;
+	}
+
+private:
+	uint32_t m_epoch = 0;
+	std::vector<uint32_t> m_padStamps;
+	std::vector<uint32_t> m_padSlots;
+	std::vector<uint32_t> m_pathStamps;
 };
 
 // Grid manager class
-class GridManager {
+// Each routing layer has its own plane of cells, a pad is registered on every layer it has a shape on
+// Two-level grid: a cell holding more than refineThreshold records is split into a fixed sub-grid of
+// finer cells, so dense areas get small cells without shrinking the whole grid (0 keeps the grid uniform)
+class GridManager : public ObstacleIndex {
 public:
-	GridManager(double minX, double minY,double maxX, double maxY,double cellSize)
+	GridManager(double minX, double minY,double maxX, double maxY,double cellSize, int refineThreshold = 0)
 		: m_minX(minX), m_minY(minY),
 		m_maxX(maxX), m_maxY(maxY),
-		m_cellSize(cellSize)
+		m_cellSize(cellSize), m_refineThreshold(refineThreshold)
 	{
 		m_numCellsX = static_cast<int>(
 			std::ceil((m_maxX - m_minX) / m_cellSize));
 		m_numCellsY = static_cast<int>(
 			std::ceil((m_maxY - m_minY) / m_cellSize));
-
-		m_gridCells.resize(m_numCellsX * m_numCellsY);
-		for (int y = 0; y < m_numCellsY; ++y) {
-			for (int x = 0; x < m_numCellsX; ++x) {
-				m_gridCells[y * m_numCellsX + x] =
-					std::make_unique<GridCell>(x, y, m_cellSize);
-			}
-		}
+	}
+	// Snapshot copy, cells and sub-grids are shared until the writer modifies them
+	GridManager(const GridManager& other)
+		: ObstacleIndex(other), m_minX(other.m_minX), m_minY(other.m_minY),
+		m_maxX(other.m_maxX), m_maxY(other.m_maxY), m_cellSize(other.m_cellSize),
+		m_refineThreshold(other.m_refineThreshold), m_numCellsX(other.m_numCellsX), m_numCellsY(other.m_numCellsY),
+		m_planes(other.m_planes), m_occupancy(other.m_occupancy), m_subGrids(other.m_subGrids) {
 	}
 
 	// Basic access
-	GridCell* getCell(int x, int y) const {
+	GridCell* getCell(int x, int y, int layer) const {
 		if (x < 0 || x >= m_numCellsX ||
-			y < 0 || y >= m_numCellsY)
+			y < 0 || y >= m_numCellsY || !hasPlane(layer))
 			return nullptr;
-		return m_gridCells[y * m_numCellsX + x].get();
+		return m_planes[layer][y * m_numCellsX + x].get();
 	}
 
-	GridCell* getCellAtPoint(const Point& p) const {
-		return getCell(getCellX(p.x), getCellY(p.y));
+	GridCell* getCellAtPoint(const Point& p, int layer) const {
+		return getCell(getCellX(p.x), getCellY(p.y), layer);
 	}
 
-	const std::vector<std::unique_ptr<GridCell>>& getAllCells() const {
-		return m_gridCells;
+	// All cells of one layer (empty if nothing was ever added on that layer)
+	const std::vector<std::shared_ptr<GridCell>>& getAllCells(int layer) const {
+		static const std::vector<std::shared_ptr<GridCell>> noCells;
+		return hasPlane(layer) ? m_planes[layer] : noCells;
 	}
+	int getMaxLayer() const override { return (int)m_planes.size() - 1; }
 
-	void addPinPad(PinPad* pad) const {
+	void addPinPad(PinPad* pad) override {
 		if (!pad) return;
+		GridPad gridPad = makeGridPad(pad);
 
 		int sx = getCellX(pad->box[0]);
 		int sy = getCellY(pad->box[1]);
 		int ex = getCellX(pad->box[2] - MapMinValue);
 		int ey = getCellY(pad->box[3] - MapMinValue);
 
-		for (int y = sy; y <= ey; ++y) {
-			for (int x = sx; x <= ex; ++x) {
-				GridCell* c = getCell(x, y);
-				if (c && c->intersects(pad))
-					c->addPinPad(pad);
+		for (const auto& [layer, shape] : pad->shapes) {
+			if (layer < 0 || layer >= 64) continue;
+			ensurePlane(layer);
+			for (int y = sy; y <= ey; ++y) {
+				for (int x = sx; x <= ex; ++x) {
+					int id = y * m_numCellsX + x;
+					if (SubGrid* sub = writableSubGrid(layer, id)) {
+						for (GridCell& c : sub->cells) {
+							if (boxOverlap(c.getBBox().data(), gridPad.box) && c.intersects(pad))
+								m_occupancy[layer][id] += c.addPinPad(gridPad);
+						}
+						continue;
+					}
+					GridCell* c = m_planes[layer][id].get();
+					if (c->intersects(pad)) {
+						c = writableCell(layer, id);
+						m_occupancy[layer][id] += c->addPinPad(gridPad);
+						refineIfDense(layer, id);
+					}
+				}
 			}
 		}
+		bumpVersion();
 	}
-	void removePinPad(PinPad* pad) const {
+	void removePinPad(PinPad* pad) override {
 		if (!pad) return;
 		int sx = getCellX(pad->box[0]);
 		int sy = getCellY(pad->box[1]);
 		int ex = getCellX(pad->box[2] - MapMinValue);
 		int ey = getCellY(pad->box[3] - MapMinValue);
-		for (int y = sy; y <= ey; ++y) {
-			for (int x = sx; x <= ex; ++x) {
-				GridCell* c = getCell(x, y);
-				if (!c) continue;
-
-				// ⚠️ Do we need intersects?
-				// → No, just erase directly
-				c->removePinPad(pad);
+		for (const auto& [layer, shape] : pad->shapes) {
+			if (!hasPlane(layer)) continue;
+			for (int y = sy; y <= ey; ++y) {
+				for (int x = sx; x <= ex; ++x) {
+					int id = y * m_numCellsX + x;
+					if (SubGrid* sub = writableSubGrid(layer, id)) {
+						for (GridCell& c : sub->cells)
+							m_occupancy[layer][id] -= c.removePinPad(pad);
+					}
+					else
+						m_occupancy[layer][id] -= writableCell(layer, id)->removePinPad(pad);
+				}
 			}
 		}
+		bumpVersion();
 	}
 
-	void addShapeLines(PolyShape* shape) const {
+	void addShapeLines(PolyShape* shape) override {
 		if (!shape) return;
+		std::vector<int> ids;
+		std::vector<std::pair<int, int>>& shapeCells = m_shapeCells[shape];
 		for (PathLine& e : shape->edges) {
+			if (e.layer < 0 || e.layer >= 64) continue;
+			ensurePlane(e.layer);
+			GridSegment segment = makeGridSegment(e, shape);
 			Line l(e.p1->pos, e.p2->pos);
-			std::vector<GridCell*> cells;
-			getCellsAlongLine(l, cells);
-			for (GridCell* c : cells)
-				c->addPathLines(&e, shape);
+			getCellIdsAlongLine(l, ids);
+			for (int id : ids) {
+				if (SubGrid* sub = writableSubGrid(e.layer, id)) {
+					for (GridCell& c : sub->cells) {
+						if (segmentHitsBox(segment.p1, segment.p2, c.getBBox().data(), 0))
+							m_occupancy[e.layer][id] += c.addPathLines(segment);
+					}
+				}
+				else {
+					m_occupancy[e.layer][id] += writableCell(e.layer, id)->addPathLines(segment);
+					refineIfDense(e.layer, id);
+				}
+				shapeCells.emplace_back(e.layer, id);
+			}
 		}
+		std::sort(shapeCells.begin(), shapeCells.end());
+		shapeCells.erase(std::unique(shapeCells.begin(), shapeCells.end()), shapeCells.end());
+		bumpVersion();
 	}
 
-	void removeOnePath(PolyShape* shape) const {
+	// Removal only visits the cells recorded when the path was added,
+	// the node positions may have changed since then
+	void removeOnePath(PolyShape* shape) override {
 		if (!shape) return;
-
-		for (PathLine& e : shape->edges) {
-			Line l(e.p1->pos, e.p2->pos);
-			std::vector<GridCell*> cells;
-			getCellsAlongLine(l, cells);
-			for (GridCell* c : cells)
-				c->removePathLines(&e);
-		}
-
-		// Final cleanup
-		for (const auto& cp : m_gridCells) {
-			auto& mp = cp->getPathLines();
-			std::vector<PathLine*> dead;
-			for (const auto& kv : mp)
-				if (kv.second == shape)
-					dead.push_back(kv.first);
-			for (auto* k : dead)
-				cp->removePathLines(k);
+		auto it = m_shapeCells.find(shape);
+		if (it == m_shapeCells.end()) return;
+		for (const auto& [layer, id] : it->second) {
+			if (SubGrid* sub = writableSubGrid(layer, id)) {
+				for (GridCell& c : sub->cells)
+					m_occupancy[layer][id] -= c.removeShapeLines(shape);
+			}
+			else
+				m_occupancy[layer][id] -= writableCell(layer, id)->removeShapeLines(shape);
 		}
+		m_shapeCells.erase(it);
+		bumpVersion();
 	}
 
-	void clearAllPathLines() const {
-		for (const auto& c : m_gridCells)
-			c->clearAllPathLines();
+	void clearAllPathLines() override {
+		for (size_t layer = 0; layer < m_planes.size(); ++layer) {
+			for (int id = 0; id < (int)m_planes[layer].size(); ++id) {
+				if (m_occupancy[layer][id] <= 0) continue;
+				if (SubGrid* sub = writableSubGrid((int)layer, id)) {
+					for (GridCell& c : sub->cells)
+						m_occupancy[layer][id] -= c.clearAllPathLines();
+				}
+				else
+					m_occupancy[layer][id] -= writableCell((int)layer, id)->clearAllPathLines();
+			}
+		}
+		m_shapeCells.clear();
+		bumpVersion();
 	}
 
-	// Box query
-	
-	void getCellsInBox(const std::vector<double>& b,std::vector<GridCell*>& cells) const{
-		if (b.size() < 4) return;
+	// Box query, only cells holding obstacles on the layer are returned
+	void getCellsInBox(const Box& b, int layer, std::vector<GridCell*>& cells) const override {
 		cells.clear();
+		if (!hasPlane(layer)) return;
 		int sx = getCellX(b[0]);
 		int sy = getCellY(b[1]);
 		int ex = getCellX(b[2] - MapMinValue);
 		int ey = getCellY(b[3] - MapMinValue);
 
+		const std::vector<int>& occupancy = m_occupancy[layer];
 		for (int y = sy; y <= ey; ++y)
-			for (int x = sx; x <= ex; ++x)
-				if (GridCell* c = getCell(x, y))
-					cells.push_back(c);
+			for (int x = sx; x <= ex; ++x) {
+				int id = y * m_numCellsX + x;
+				if (occupancy[id] <= 0) continue;
+				if (const SubGrid* sub = m_subGrids[layer][id].get()) {
+					for (const GridCell& c : sub->cells) {
+						if (c.recordCount() > 0 && boxOverlap(c.getBBox().data(), b.data()))
+							cells.push_back(const_cast<GridCell*>(&c));
+					}
+				}
+				else
+					cells.push_back(m_planes[layer][id].get());
+			}
 	}
-	
-	void getCellsInBox1(const vector<double>& bounds, vector<GridCell*>& cells) const {
-		if (bounds.size() < 4) {
-			return;
-		}
+
+	// Line segment crosses all cells, only cells holding obstacles on the layer are returned
+	void getCellsAlongLine(const Line& line, int layer,
+		std::vector<GridCell*>& cells) const
+	{
+		cells.clear();
+		if (!hasPlane(layer)) return;
+		getCellsInCorridor(line, 0, layer, cells);
+	}
+	// Cells touched by the segment widened by width, only cells holding obstacles on the layer are returned
+	void getCellsAlongLine2(const Line& line,const double& width, int layer, std::vector<GridCell*>& cells) const override {
 		cells.clear();
-		const double& minX = bounds[0];
-		const double& minY = bounds[1];
-		const double& maxX = bounds[2];
-		const double& maxY = bounds[3];
+		if (!hasPlane(layer)) return;
+		// Degenerate to no width
+		double halfW = width > MapMinValue ? 0.5 * width : 0;
+		getCellsInCorridor(line, halfW, layer, cells);
+	}
 
-		if (minX > maxX || minY > maxY) {
-			return;
+protected:
+	std::shared_ptr<const ObstacleIndex> makeSnapshot() const override {
+		return std::make_shared<const GridManager>(*this);
+	}
+
+private:
+	// Finer cells replacing one coarse cell, SubGridDivs x SubGridDivs
+	static constexpr int SubGridDivs = 4;
+	struct SubGrid {
+		std::vector<GridCell> cells;
+	};
+
+	bool hasPlane(int layer) const {
+		return layer >= 0 && layer < (int)m_planes.size() && !m_planes[layer].empty();
+	}
+	// Copy-on-write: a cell or sub-grid still referenced by a published snapshot is copied before it is modified
+	// (only the writer thread calls these, so a use count of 1 means no snapshot can see the object)
+	GridCell* writableCell(int layer, int id) {
+		std::shared_ptr<GridCell>& cell = m_planes[layer][id];
+		if (cell.use_count() > 1)
+			cell = std::make_shared<GridCell>(*cell);
+		return cell.get();
+	}
+	SubGrid* writableSubGrid(int layer, int id) {
+		std::shared_ptr<SubGrid>& sub = m_subGrids[layer][id];
+		if (sub && sub.use_count() > 1)
+			sub = std::make_shared<SubGrid>(*sub);
+		return sub.get();
+	}
+	void ensurePlane(int layer) {
+		if (layer >= (int)m_planes.size()) {
+			m_planes.resize(layer + 1);
+			m_occupancy.resize(layer + 1);
+			m_subGrids.resize(layer + 1);
 		}
-		// Calculate grid range covered by bounding box (consider left-open right-closed)
-		int startX = getCellX(minX);
-		int startY = getCellY(minY);
-		int endX = getCellX(maxX);
-		int endY = getCellY(maxY);
-
-		// Handle boundary case: if max.y is exactly on grid boundary, include previous grid
-		double remainderY = std::fmod(maxY - m_minY, m_cellSize);
-		if (std::abs(remainderY) < MapMinValue) {
-			endY = std::max(0, endY - 1);
-		}
-
-		// Ensure indices are within valid range
-		startX = std::max(0, startX);
-		startY = std::max(0, startY);
-		endX = std::min(m_numCellsX - 1, endX);
-		endY = std::min(m_numCellsY - 1, endY);
-
-		// Ensure indices are within valid range
-		startX = std::max(0, startX);
-		startY = std::max(0, startY);
-		endX = std::min(m_numCellsX - 1, endX);
-		endY = std::min(m_numCellsY - 1, endY);
-
-		// Iterate through all involved grid cells
-		for (int y = startY; y <= endY; ++y) {
-			for (int x = startX; x <= endX; ++x) {
-				if (GridCell* cell = getCell(x, y)) {
-					cells.emplace_back(cell);
-				}
+		if (!m_planes[layer].empty()) return;
+		std::vector<std::shared_ptr<GridCell>>& plane = m_planes[layer];
+		plane.resize(m_numCellsX * m_numCellsY);
+		for (int y = 0; y < m_numCellsY; ++y) {
+			for (int x = 0; x < m_numCellsX; ++x) {
+				double cellMinX = m_minX + x * m_cellSize;
+				double cellMinY = m_minY + y * m_cellSize;
+				plane[y * m_numCellsX + x] =
+					std::make_shared<GridCell>(cellMinX, cellMinY, cellMinX + m_cellSize, cellMinY + m_cellSize);
 			}
 		}
+		m_occupancy[layer].assign(m_numCellsX * m_numCellsY, 0);
+		m_subGrids[layer].resize(m_numCellsX * m_numCellsY);
 	}
 
-	// Line segment crosses all cells
-	void getCellsAlongLine(const Line& line,
-		std::vector<GridCell*>& cells) const
-	{
-		cells.clear();
+	// Split a coarse cell into a sub-grid once it holds too many records, the records are redistributed
+	void refineIfDense(int layer, int id) {
+		if (m_refineThreshold <= 0 || m_occupancy[layer][id] <= m_refineThreshold) return;
+		GridCell* coarse = writableCell(layer, id);
+		const Box& bbox = coarse->getBBox();
+		double subSize = m_cellSize / SubGridDivs;
+		auto sub = std::make_shared<SubGrid>();
+		sub->cells.reserve(SubGridDivs * SubGridDivs);
+		for (int y = 0; y < SubGridDivs; ++y) {
+			for (int x = 0; x < SubGridDivs; ++x)
+				sub->cells.emplace_back(bbox[0] + x * subSize, bbox[1] + y * subSize, bbox[0] + (x + 1) * subSize, bbox[1] + (y + 1) * subSize);
+		}
+		int count = 0;
+		for (GridCell& c : sub->cells) {
+			for (const GridSegment& seg : coarse->getPathLines()) {
+				if (segmentHitsBox(seg.p1, seg.p2, c.getBBox().data(), 0))
+					count += c.addPathLines(seg);
+			}
+			for (const GridPad& gp : coarse->getPinPads()) {
+				if (boxOverlap(c.getBBox().data(), gp.box) && c.intersects(gp.pad))
+					count += c.addPinPad(gp);
+			}
+		}
+		coarse->clearAllPathLines();
+		while (!coarse->getPinPads().empty())
+			coarse->removePinPad(coarse->getPinPads().back().pad);
+		m_occupancy[layer][id] = count;
+		m_subGrids[layer][id] = std::move(sub);
+	}
+
+	// Supercover of the corridor around the segment (every cell within halfW of it, square caps) in one pass:
+	// each cell row is visited once and the corridor covers a contiguous run of cells in it,
+	// so no deduplication and no temporary storage is needed
+	void getCellsInCorridor(const Line& line, double halfW, int layer, std::vector<GridCell*>& cells) const {
+		const Point& p1 = line.Pt1;
+		const Point& p2 = line.Pt2;
+		double dx = p2.x - p1.x;
+		double dy = p2.y - p1.y;
+		const std::vector<int>& occupancy = m_occupancy[layer];
+		int sy = getCellY(std::min(p1.y, p2.y) - halfW);
+		int ey = getCellY(std::max(p1.y, p2.y) + halfW - MapMinValue);
+		for (int iy = sy; iy <= ey; ++iy) {
+			// Rows on the border also hold everything beyond the boundary
+			double rowLo = iy == 0 ? -std::numeric_limits<double>::infinity() : m_minY + iy * m_cellSize;
+			double rowHi = iy == m_numCellsY - 1 ? std::numeric_limits<double>::infinity() : m_minY + (iy + 1) * m_cellSize;
+			// Part of the segment whose widened band overlaps the row
+			double t0 = 0, t1 = 1;
+			if (std::abs(dy) > 1e-12) {
+				double ta = (rowLo - halfW - MapMinValue - p1.y) / dy;
+				double tb = (rowHi + halfW + MapMinValue - p1.y) / dy;
+				if (ta > tb) std::swap(ta, tb);
+				t0 = std::max(t0, ta);
+				t1 = std::min(t1, tb);
+				if (t0 > t1) continue;
+			}
+			double x0 = p1.x + t0 * dx;
+			double x1 = p1.x + t1 * dx;
+			int sx = getCellX(std::min(x0, x1) - halfW);
+			int ex = getCellX(std::max(x0, x1) + halfW - MapMinValue);
+			for (int ix = sx; ix <= ex; ++ix) {
+				int id = iy * m_numCellsX + ix;
+				if (occupancy[id] > 0)
+					pushOccupiedCells(line, halfW, layer, id, cells);
+			}
+		}
+	}
+
+	// Occupied cells of coarse cell id touched by the segment corridor (the cell itself if it is not refined)
+	void pushOccupiedCells(const Line& line, double halfW, int layer, int id, std::vector<GridCell*>& cells) const {
+		const SubGrid* sub = m_subGrids[layer][id].get();
+		if (!sub) {
+			cells.push_back(m_planes[layer][id].get());
+			return;
+		}
+		for (const GridCell& c : sub->cells) {
+			if (c.recordCount() > 0 && segmentHitsBox(line.Pt1, line.Pt2, c.getBBox().data(), halfW))
+				cells.push_back(const_cast<GridCell*>(&c));
+		}
+	}
+
+	// Cell ids (y * numCellsX + x) crossed by a line segment, in traversal order
+	void getCellIdsAlongLine(const Line& line, std::vector<int>& ids) const {
+		ids.clear();
 
 		const Point& p0 = line.Pt1;
 		const Point& p1 = line.Pt2;
@@ -350,9 +887,7 @@ public:
 		int stepY = (dy > MapMinValue) ? 1 :
 			(dy < -MapMinValue) ? -1 : 0;
 
-		GridCell* startCell = getCell(ix, iy);
-		if (startCell)
-			cells.push_back(startCell);
+		ids.push_back(iy * m_numCellsX + ix);
 
 		if (stepX == 0 && stepY == 0)
 			return;
@@ -396,56 +931,12 @@ public:
 				iy < 0 || iy >= m_numCellsY)
 				break;
 
-			GridCell* c = getCell(ix, iy);
-			if (c && cells.back() != c)
-				cells.push_back(c);
-		}
-	}
-	void getCellsAlongLine2(const Line& line,const double& width,std::vector<GridCell*>& cells) const{
-		cells.clear();
-		if (width <= MapMinValue) {
-			// Degenerate to no width
-			getCellsAlongLine(line, cells);
-			return;
-		}
-		Point p1 = line.Pt1;
-		Point p2 = line.Pt2;
-
-		Point dir = (p2 - p1).normalizeVec();
-		if (dir.vecLength() < MapMinValue) {
-			if (GridCell* c = getCellAtPoint(p1))
-				cells.push_back(c);
-			return;
+			int id = iy * m_numCellsX + ix;
+			if (ids.back() != id)
+				ids.push_back(id);
 		}
-
-		Point normal = dir;
-		normal.rotate90();   // Unit normal vector
-
-		double halfW = 0.5 * width;
-
-		// Extend endpoints
-		p1 = p1 - dir * halfW;
-		p2 = p2 + dir * halfW;
-
-		Line line1(p1 + normal * halfW, p2 + normal * halfW);
-		Line line2(p1 - normal * halfW, p2 - normal * halfW);
-
-		std::unordered_set<GridCell*> visited;
-		std::vector<GridCell*> tmp;
-		auto collect = [&](const Line& l) {
-			tmp.clear();
-			getCellsAlongLine(l, tmp);
-			for (GridCell* c : tmp) {
-				if (visited.insert(c).second) {
-					cells.push_back(c);
-				}
-			}
-			};
-		collect(line1);
-		collect(line2);
 	}
 
-private:
 	// Left-closed right-open, bottom-closed top-open
 	int getCellX(double x) const {
 		double gx = (x - m_minX) / m_cellSize;
@@ -462,6 +953,10 @@ private:
 private:
 	double m_minX, m_minY, m_maxX, m_maxY;
 	double m_cellSize;
+	int m_refineThreshold;
 	int m_numCellsX, m_numCellsY;
-	std::vector<std::unique_ptr<GridCell>> m_gridCells;
-};
\ No newline at end of file
+	std::vector<std::vector<std::shared_ptr<GridCell>>> m_planes;	// Layer -> cells of that layer, shared with published snapshots
+	std::vector<std::vector<int>> m_occupancy;						// Layer -> number of records in each cell (including its sub-grid)
+	std::vector<std::vector<std::shared_ptr<SubGrid>>> m_subGrids;	// Layer -> sub-grid of each refined cell, null if not refined
+	std::unordered_map<const PolyShape*, std::vector<std::pair<int, int>>> m_shapeCells;	// Path -> (layer, cell id) it was added to
+};
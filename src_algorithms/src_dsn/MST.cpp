@@ -6,7 +6,7 @@
 #include <algorithm>
 #include <limits>
 #include <memory>
-#include <string>>
+#include <string>
 
 void SteinerTreeSolver::computeSteinerTrees(
 	std::unordered_map<std::string, std::vector<PinPad*>>& nets,
@@ -0,0 +1,90 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+
+#include "RoutingNode.h"
+
+// Open list of the PPDT search: indexed 4-ary min-heap on f, ordered like ComparePathTreePtr
+// Each queued node keeps its slot in PathTree::heapIndex, so a node whose f changed is re-ordered in place
+// (decrease-key) instead of leaving a stale entry behind
+class PathTreeHeap {
+public:
+	bool empty() const { return m_nodes.empty(); }
+	size_t size() const { return m_nodes.size(); }
+	PathTree* top() const { return m_nodes.front(); }
+	bool contains(const PathTree* node) const {
+		return node->heapIndex >= 0 && node->heapIndex < (int)m_nodes.size() && m_nodes[node->heapIndex] == node;
+	}
+
+	// Queue node, or re-order it if it is already queued
+	void push(PathTree* node) {
+		if (contains(node)) {
+			update(node);
+			return;
+		}
+		node->heapIndex = (int)m_nodes.size();
+		m_nodes.push_back(node);
+		siftUp(node->heapIndex);
+	}
+	void pop() {
+		PathTree* node = m_nodes.front();
+		node->heapIndex = -1;
+		PathTree* last = m_nodes.back();
+		m_nodes.pop_back();
+		if (m_nodes.empty()) return;
+		m_nodes[0] = last;
+		last->heapIndex = 0;
+		siftDown(0);
+	}
+	// Restore the order after the f value of a queued node changed
+	void update(PathTree* node) {
+		if (!contains(node)) return;
+		int i = node->heapIndex;
+		siftUp(i);
+		if (node->heapIndex == i)
+			siftDown(i);
+	}
+	void clear() {
+		for (PathTree* node : m_nodes)
+			node->heapIndex = -1;
+		m_nodes.clear();
+	}
+
+private:
+	static constexpr int Arity = 4;
+	std::vector<PathTree*> m_nodes;
+	ComparePathTreePtr m_after;		// m_after(a, b): a is expanded after b
+
+	void place(int i, PathTree* node) {
+		m_nodes[i] = node;
+		node->heapIndex = i;
+	}
+	void siftUp(int i) {
+		PathTree* node = m_nodes[i];
+		while (i > 0) {
+			int parent = (i - 1) / Arity;
+			if (!m_after(m_nodes[parent], node)) break;
+			place(i, m_nodes[parent]);
+			i = parent;
+		}
+		place(i, node);
+	}
+	void siftDown(int i) {
+		PathTree* node = m_nodes[i];
+		int n = (int)m_nodes.size();
+		while (true) {
+			int first = i * Arity + 1;
+			if (first >= n) break;
+			int best = first;
+			int last = std::min(first + Arity, n);
+			for (int c = first + 1; c < last; ++c) {
+				if (m_after(m_nodes[best], m_nodes[c]))
+					best = c;
+			}
+			if (!m_after(node, m_nodes[best])) break;
+			place(i, m_nodes[best]);
+			i = best;
+		}
+		place(i, node);
+	}
+};
@@ -0,0 +1,221 @@
+#pragma once
+#include <array>
+
+#include "Grid.h"
+
+// Bucketed quadtree obstacle index, one tree per layer
+// A leaf bucket is split into four when it holds more than m_leafCapacity records and is still larger than m_minLeafSize,
+// so dense areas (BGA fields) get small buckets while empty areas stay as a few large ones
+class QuadTreeIndex : public ObstacleIndex {
+public:
+	QuadTreeIndex(double minX, double minY, double maxX, double maxY, double minLeafSize, int leafCapacity = 16)
+		: m_minLeafSize(minLeafSize), m_leafCapacity(leafCapacity)
+	{
+		// Leave a margin so that obstacles slightly outside the boundary are still indexed
+		double margin = 0.05 * std::max(maxX - minX, maxY - minY) + 1;
+		double size = std::max(maxX - minX, maxY - minY) + 2 * margin;
+		m_rootBox = { minX - margin, minY - margin, minX - margin + size, minY - margin + size };
+	}
+
+	int getMaxLayer() const override { return (int)m_roots.size() - 1; }
+
+	void addPinPad(PinPad* pad) override {
+		if (!pad) return;
+		GridPad gridPad = makeGridPad(pad);
+		for (const auto& [layer, shape] : pad->shapes) {
+			if (layer < 0 || layer >= 64) continue;
+			insertPad(ensureRoot(layer), gridPad);
+		}
+		bumpVersion();
+	}
+	void removePinPad(PinPad* pad) override {
+		if (!pad) return;
+		for (const auto& [layer, shape] : pad->shapes) {
+			if (hasRoot(layer))
+				removePad(m_roots[layer].get(), pad);
+		}
+		bumpVersion();
+	}
+
+	void addShapeLines(PolyShape* shape) override {
+		if (!shape) return;
+		std::vector<std::pair<int, std::array<double, 4>>>& shapeBoxes = m_shapeBoxes[shape];
+		for (PathLine& e : shape->edges) {
+			if (e.layer < 0 || e.layer >= 64) continue;
+			GridSegment segment = makeGridSegment(e, shape);
+			insertSegment(ensureRoot(e.layer), segment);
+			// Remember the area covered on each layer for removal
+			std::array<double, 4> box = { std::min(segment.p1.x, segment.p2.x), std::min(segment.p1.y, segment.p2.y),
+				std::max(segment.p1.x, segment.p2.x), std::max(segment.p1.y, segment.p2.y) };
+			auto it = std::find_if(shapeBoxes.begin(), shapeBoxes.end(), [&](const auto& lb) { return lb.first == e.layer; });
+			if (it == shapeBoxes.end())
+				shapeBoxes.emplace_back(e.layer, box);
+			else {
+				it->second[0] = std::min(it->second[0], box[0]);
+				it->second[1] = std::min(it->second[1], box[1]);
+				it->second[2] = std::max(it->second[2], box[2]);
+				it->second[3] = std::max(it->second[3], box[3]);
+			}
+		}
+		bumpVersion();
+	}
+	void removeOnePath(PolyShape* shape) override {
+		if (!shape) return;
+		auto it = m_shapeBoxes.find(shape);
+		if (it == m_shapeBoxes.end()) return;
+		for (const auto& [layer, box] : it->second) {
+			if (hasRoot(layer))
+				removeShape(m_roots[layer].get(), shape, box.data());
+		}
+		m_shapeBoxes.erase(it);
+		bumpVersion();
+	}
+	void clearAllPathLines() override {
+		for (auto& root : m_roots) {
+			if (root)
+				clearPathLines(root.get());
+		}
+		m_shapeBoxes.clear();
+		bumpVersion();
+	}
+
+	void getCellsInBox(const Box& b, int layer, std::vector<GridCell*>& cells) const override {
+		cells.clear();
+		if (!hasRoot(layer)) return;
+		collectInBox(m_roots[layer].get(), b.data(), cells);
+	}
+	void getCellsAlongLine2(const Line& line, const double& width, int layer, std::vector<GridCell*>& cells) const override {
+		cells.clear();
+		if (!hasRoot(layer)) return;
+		double halfW = width > MapMinValue ? 0.5 * width : 0;
+		collectAlongLine(m_roots[layer].get(), line.Pt1, line.Pt2, halfW, cells);
+	}
+
+private:
+	struct QuadNode {
+		double box[4];							// minX, minY, maxX, maxY
+		std::unique_ptr<QuadNode> children[4];
+		std::unique_ptr<GridCell> bucket;		// Only leaves hold records
+		bool isLeaf() const { return bucket != nullptr; }
+	};
+
+	double m_minLeafSize;
+	int m_leafCapacity;
+	std::array<double, 4> m_rootBox;
+	std::vector<std::unique_ptr<QuadNode>> m_roots;		// Layer -> root
+	std::unordered_map<const PolyShape*, std::vector<std::pair<int, std::array<double, 4>>>> m_shapeBoxes;	// Path -> (layer, covered box)
+
+	bool hasRoot(int layer) const {
+		return layer >= 0 && layer < (int)m_roots.size() && m_roots[layer];
+	}
+	QuadNode* ensureRoot(int layer) {
+		if (layer >= (int)m_roots.size())
+			m_roots.resize(layer + 1);
+		if (!m_roots[layer])
+			m_roots[layer] = makeLeaf(m_rootBox[0], m_rootBox[1], m_rootBox[2], m_rootBox[3]);
+		return m_roots[layer].get();
+	}
+	static std::unique_ptr<QuadNode> makeLeaf(double minX, double minY, double maxX, double maxY) {
+		auto node = std::make_unique<QuadNode>();
+		node->box[0] = minX;
+		node->box[1] = minY;
+		node->box[2] = maxX;
+		node->box[3] = maxY;
+		node->bucket = std::make_unique<GridCell>(minX, minY, maxX, maxY);
+		return node;
+	}
+
+	bool canSplit(const QuadNode* node) const {
+		const std::vector<GridSegment>& lines = node->bucket->getPathLines();
+		const std::vector<GridPad>& pads = node->bucket->getPinPads();
+		return (int)(lines.size() + pads.size()) > m_leafCapacity &&
+			node->box[2] - node->box[0] > 2 * m_minLeafSize;
+	}
+	void split(QuadNode* node) {
+		double midX = 0.5 * (node->box[0] + node->box[2]);
+		double midY = 0.5 * (node->box[1] + node->box[3]);
+		node->children[0] = makeLeaf(node->box[0], node->box[1], midX, midY);
+		node->children[1] = makeLeaf(midX, node->box[1], node->box[2], midY);
+		node->children[2] = makeLeaf(node->box[0], midY, midX, node->box[3]);
+		node->children[3] = makeLeaf(midX, midY, node->box[2], node->box[3]);
+		std::unique_ptr<GridCell> bucket = std::move(node->bucket);
+		for (const GridSegment& seg : bucket->getPathLines())
+			insertSegment(node, seg);
+		for (const GridPad& gp : bucket->getPinPads())
+			insertPad(node, gp);
+	}
+
+	void insertSegment(QuadNode* node, const GridSegment& seg) {
+		if (!segmentHitsBox(seg.p1, seg.p2, node->box, 0)) return;
+		if (node->isLeaf()) {
+			node->bucket->addPathLines(seg);
+			if (canSplit(node))
+				split(node);
+			return;
+		}
+		for (auto& child : node->children)
+			insertSegment(child.get(), seg);
+	}
+	void insertPad(QuadNode* node, const GridPad& gp) {
+		if (!boxOverlap(node->box, gp.box)) return;
+		if (node->isLeaf()) {
+			if (!node->bucket->intersects(gp.pad)) return;
+			node->bucket->addPinPad(gp);
+			if (canSplit(node))
+				split(node);
+			return;
+		}
+		for (auto& child : node->children)
+			insertPad(child.get(), gp);
+	}
+	void removePad(QuadNode* node, PinPad* pad) {
+		if (!boxOverlap(node->box, pad->box.data())) return;
+		if (node->isLeaf()) {
+			node->bucket->removePinPad(pad);
+			return;
+		}
+		for (auto& child : node->children)
+			removePad(child.get(), pad);
+	}
+	void removeShape(QuadNode* node, const PolyShape* shape, const double* box) {
+		if (!boxOverlap(node->box, box)) return;
+		if (node->isLeaf()) {
+			node->bucket->removeShapeLines(shape);
+			return;
+		}
+		for (auto& child : node->children)
+			removeShape(child.get(), shape, box);
+	}
+	void clearPathLines(QuadNode* node) {
+		if (node->isLeaf()) {
+			node->bucket->clearAllPathLines();
+			return;
+		}
+		for (auto& child : node->children)
+			clearPathLines(child.get());
+	}
+
+	static bool isEmpty(const GridCell* bucket) {
+		return bucket->getPathLines().empty() && bucket->getPinPads().empty();
+	}
+	void collectInBox(QuadNode* node, const double* b, std::vector<GridCell*>& cells) const {
+		if (!boxOverlap(node->box, b)) return;
+		if (node->isLeaf()) {
+			if (!isEmpty(node->bucket.get()))
+				cells.push_back(node->bucket.get());
+			return;
+		}
+		for (auto& child : node->children)
+			collectInBox(child.get(), b, cells);
+	}
+	void collectAlongLine(QuadNode* node, const Point& p1, const Point& p2, double halfW, std::vector<GridCell*>& cells) const {
+		if (!segmentHitsBox(p1, p2, node->box, halfW)) return;
+		if (node->isLeaf()) {
+			if (!isEmpty(node->bucket.get()))
+				cells.push_back(node->bucket.get());
+			return;
+		}
+		for (auto& child : node->children)
+			collectAlongLine(child.get(), p1, p2, halfW, cells);
+	}
+};
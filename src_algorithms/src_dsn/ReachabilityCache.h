@@ -0,0 +1,142 @@
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+
+#include "Grid.h"
+
+// Memoized first-obstacle answers of getFirstShape
+// Keyed by the quantized segment, layer, net (width/clearance class) and the ignored pads. The index also changes in the
+// middle of a search (checkViaPos pushes traces, vias are placed), so every change stamps the square regions of its layer
+// it can reach, and an answer is only reused while no region around its segment was stamped after it was stored
+class ReachabilityCache {
+public:
+	struct Key {
+		int64_t x1, y1, x2, y2;				// Endpoints quantized to Point::minNumber
+		int layer;
+		int netId;
+		int64_t width, clearance;			// Quantized like the endpoints
+		const PinPad* ignorePad1;
+		const PinPad* ignorePad2;
+
+		bool operator==(const Key& k) const {
+			return x1 == k.x1 && y1 == k.y1 && x2 == k.x2 && y2 == k.y2 && layer == k.layer && netId == k.netId &&
+				width == k.width && clearance == k.clearance && ignorePad1 == k.ignorePad1 && ignorePad2 == k.ignorePad2;
+		}
+	};
+	struct KeyHash {
+		size_t operator()(const Key& k) const {
+			uint64_t h = 1469598103934665603ull;
+			auto mix = [&h](uint64_t v) { h = (h ^ v) * 1099511628211ull; };
+			mix((uint64_t)k.x1);
+			mix((uint64_t)k.y1);
+			mix((uint64_t)k.x2);
+			mix((uint64_t)k.y2);
+			mix(((uint64_t)(uint32_t)k.layer << 32) | (uint32_t)k.netId);
+			mix((uint64_t)k.width);
+			mix((uint64_t)k.clearance);
+			mix((uint64_t)(uintptr_t)k.ignorePad1);
+			mix((uint64_t)(uintptr_t)k.ignorePad2);
+			return (size_t)(h ^ (h >> 29));
+		}
+	};
+
+	explicit ReachabilityCache(size_t capacity = 1 << 18) : m_capacity(capacity) {}
+
+	static Key makeKey(const Point& p1, const Point& p2, int layer, int netId, double width, double clearance,
+		const PinPad* ignorePad1, const PinPad* ignorePad2) {
+		return { quantize(p1.x), quantize(p1.y), quantize(p2.x), quantize(p2.y), layer, netId,
+			quantize(width), quantize(clearance), ignorePad1, ignorePad2 };
+	}
+
+	// A new obstacle index starts over, regionSize is the side of the invalidation regions
+	void reset(double regionSize) {
+		clear();
+		m_regionSize = regionSize > 0 ? regionSize : 1;
+	}
+	void clear() {
+		m_entries.clear();
+		m_regionStamps.clear();
+		m_stamp = 0;
+	}
+
+	// An obstacle on layer with bounding box box (including its own half width) and clearance entered or left the index
+	void obstacleChanged(const Box& box, double clearance, int layer) {
+		if (m_entries.empty()) return;
+		++m_stamp;
+		int64_t rx0 = regionCoord(box[0] - clearance), ry0 = regionCoord(box[1] - clearance);
+		int64_t rx1 = regionCoord(box[2] + clearance), ry1 = regionCoord(box[3] + clearance);
+		for (int64_t rx = rx0; rx <= rx1; ++rx) {
+			for (int64_t ry = ry0; ry <= ry1; ++ry)
+				m_regionStamps[RegionKey{ rx, ry, layer }] = m_stamp;
+		}
+	}
+
+	bool find(const Key& key, PolyShape*& firstObs) {
+		auto it = m_entries.find(key);
+		if (it == m_entries.end())
+			return false;
+		Entry& entry = it->second;
+		if (entry.stamp != m_stamp) {
+			if (regionChangedSince(key, entry.stamp)) {
+				m_entries.erase(it);
+				return false;
+			}
+			entry.stamp = m_stamp;		// Still valid now, later checks only look at newer changes
+		}
+		firstObs = entry.firstObs;
+		return true;
+	}
+	void store(const Key& key, PolyShape* firstObs) {
+		if (m_entries.size() >= m_capacity)
+			m_entries.clear();
+		m_entries[key] = Entry{ firstObs, m_stamp };
+	}
+
+private:
+	struct Entry {
+		PolyShape* firstObs;
+		uint64_t stamp;				// Last change the answer is known to hold after
+	};
+	struct RegionKey {
+		int64_t rx, ry;
+		int layer;
+		bool operator==(const RegionKey& k) const { return rx == k.rx && ry == k.ry && layer == k.layer; }
+	};
+	struct RegionKeyHash {
+		size_t operator()(const RegionKey& k) const {
+			uint64_t h = (uint64_t)k.rx * 0x9E3779B97F4A7C15ull;
+			h ^= (uint64_t)k.ry * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+			h ^= (uint64_t)(uint32_t)k.layer * 0x165667B19E3779F9ull;
+			return (size_t)(h ^ (h >> 31));
+		}
+	};
+
+	static constexpr double m_quantum = 0.0001;		// Point::minNumber, points closer than this compare equal
+	static int64_t quantize(double v) { return (int64_t)std::llround(v / m_quantum); }
+	int64_t regionCoord(double v) const { return (int64_t)std::floor(v / m_regionSize); }
+
+	// Any obstacle that can block the segment comes within its half width plus clearance (plus the obstacle's own
+	// clearance, which obstacleChanged adds on its side)
+	bool regionChangedSince(const Key& key, uint64_t stamp) const {
+		double reach = (key.width / 2 + key.clearance + 1) * m_quantum;
+		double x0 = std::min(key.x1, key.x2) * m_quantum - reach, y0 = std::min(key.y1, key.y2) * m_quantum - reach;
+		double x1 = std::max(key.x1, key.x2) * m_quantum + reach, y1 = std::max(key.y1, key.y2) * m_quantum + reach;
+		int64_t rx0 = regionCoord(x0), ry0 = regionCoord(y0), rx1 = regionCoord(x1), ry1 = regionCoord(y1);
+		for (int64_t rx = rx0; rx <= rx1; ++rx) {
+			for (int64_t ry = ry0; ry <= ry1; ++ry) {
+				auto it = m_regionStamps.find(RegionKey{ rx, ry, key.layer });
+				if (it != m_regionStamps.end() && it->second > stamp)
+					return true;
+			}
+		}
+		return false;
+	}
+
+	size_t m_capacity;
+	double m_regionSize = 1;
+	uint64_t m_stamp = 0;						// Number of changes seen since the last reset
+	std::unordered_map<Key, Entry, KeyHash> m_entries;
+	std::unordered_map<RegionKey, uint64_t, RegionKeyHash> m_regionStamps;	// Last change that reached each region
+};
@@ -47,7 +47,7 @@ void RouterMeshless::routerReset(double& gridSize) {
 				dfs(root.get());
 			}
 		}
-		if (m_totalPins > 0) {
+		if (m_totalPins > 0 && m_grideSizeFactor > 0) {
 			gridSize = m_grideSizeFactor * std::sqrt(totalPadArea / m_totalPins);
 		}
 		else {
@@ -144,17 +144,26 @@ void RouterMeshless::initializeGrid(const double& gridSize) {
 		cerr << "Error: Invalid boundary range in initializeGrid" << endl;
 		return;
 	}
-	// 1. Create grid manager
-	m_gridManager = make_unique<GridManager>(minX, minY, maxX, maxY, gridSize);
+	// 1. Create grid manager (or quadtree, whose smallest bucket is a quarter of the grid size)
+	// Dense grid cells are refined while pads and traces are added
+	m_reachCache.reset(gridSize * 2);
+	m_congestion.reset(gridSize);
+	m_viaSites.clear();
+	m_expandedNodes.reset(gridSize);
+	m_otherSide.expandedNodes.reset(gridSize);
+	if (m_obstacleIndexType == ObstacleIndexType::QuadTree)
+		m_gridManager = make_unique<QuadTreeIndex>(minX, minY, maxX, maxY, gridSize / 4);
+	else
+		m_gridManager = make_unique<GridManager>(minX, minY, maxX, maxY, gridSize, m_gridRefineThreshold);
 	// 2. Add polygon pads corresponding to all pins to the grid
 	int totalPinPads = 0;
 	for (auto& [padName, pad] : *m_pads) {
-		m_gridManager->addPinPad(&pad);
+		addPadToGrid(&pad);
 		totalPinPads++;
 	}
 	// 3. Add polygon pads corresponding to all pre-vias to the grid
 	for (auto& [padName, pad] : *m_preVias) {
-		m_gridManager->addPinPad(&pad);
+		addPadToGrid(&pad);
 		totalPinPads++;
 	}
 	// 4. Set initial routable layers
@@ -167,7 +176,7 @@ void RouterMeshless::initializeGrid(const double& gridSize) {
 	/*
 	// Output grid statistics (for debugging)
 	if (m_gridManager) {
-		auto& allCells = m_gridManager->getAllCells();
+		auto& allCells = static_cast<GridManager*>(m_gridManager.get())->getAllCells(1);
 		int nonPadEmptyCells = 0;
 		int maxPadsInCells = 0;
 		for (auto& cell : allCells) {
@@ -186,13 +195,9 @@ void RouterMeshless::initializeGrid(const double& gridSize) {
 	*/
 }
 void RouterMeshless::freePathsAndTrees() {
-	for (auto& net : m_treesHeads) {
-		for (auto& node : net.second) {
-			node->remove();
-		}
-	}
 	m_treesHeads.clear();
 	m_pathTreesOrdered.clear();
+	m_treeArenas.clear();	// Releases every search tree
 	// Free memory for m_paths
 	for (auto& [pNode, shape] : m_paths) {
 		pNode->deleteRelatedNodes();
@@ -268,7 +273,7 @@ bool RouterMeshless::getPlanningPos(PathNode* node, Point& pos, bool isLine) {
 			bool prevSameLayer = node->prev ? node->prev->layer == node->layer : false;
 			bool nextSameLayer = node->next ? node->layer == node->next->layer : false;
 			if (prevSameLayer && nextSameLayer) {
-				pos = node->pos + node->direction * (minWireSpacing + maxClearance);
+				pos = m_fixedGrid.snap(node->pos + node->direction * (minWireSpacing + maxClearance));
 				m_planningPts.insert(pos);
 			}
 			else {	// Cross-layer, take current point
@@ -276,7 +281,7 @@ bool RouterMeshless::getPlanningPos(PathNode* node, Point& pos, bool isLine) {
 			}
 		}
 		else {
-			pos = node->pos + node->direction * minWireSpacing;
+			pos = m_fixedGrid.snap(node->pos + node->direction * minWireSpacing);
 			m_planningPts.insert(pos);
 		}
 	}
@@ -341,6 +346,7 @@ bool RouterMeshless::prepareOnePathData(pair<PinPad*, PinPad*>& pair) {
 	m_startPad = pair.first;
 	m_endPad = pair.second;
 	m_curNetName = m_startPad->netName;
+	m_curNetId = m_gridManager->getNetId(m_curNetName);
 	m_curNetInfo = &m_netsInfos->at(m_curNetName);
 	m_viaRadius = m_viaInfos->at(m_curNetInfo->viaName).m_radius;
 	//2. Initialize net routing information
@@ -363,7 +369,7 @@ bool RouterMeshless::prepareOnePathData(pair<PinPad*, PinPad*>& pair) {
 		return true;
 	}
 	//5. Reset leaf nodes for path search, reset explored planning points to zero
-	m_leafNodesList = priority_queue<PathTree*, vector<PathTree*>, ComparePathTreePtr>();
+	m_leafNodesList.clear();
 	m_exploredNodes.clear();
 	m_candidateObss = queue<PolyShape*>();
 	m_queryObssPassed.clear();
@@ -382,11 +388,12 @@ void RouterMeshless::setStartAndEnd() {
 			break;
 		}
 	}
-	//2. Create path tree nodes on selected routing layer
-	m_node_start = new PathTree(m_startPad->pos, layer_s, m_curNetName, nullptr);
+	//2. Create path tree nodes on selected routing layer, the search tree of this pin pair gets its own arena
+	m_treeArenas.emplace_back(make_unique<PathTreeArena>());
+	m_node_start = newTreeNode(m_startPad->pos, layer_s, nullptr);
 	m_PinQuaryPad.insert(make_pair(m_node_start, m_startPad));
 
-	m_node_end = new PathTree(m_endPad->pos, layer_e, m_curNetName, nullptr);
+	m_node_end = newTreeNode(m_endPad->pos, layer_e, nullptr);
 	m_PinQuaryPad.insert(make_pair(m_node_end, m_endPad));
 
 	m_pathHeads[m_node_start] = m_curNetName;
@@ -420,9 +427,9 @@ void RouterMeshless::setStartPad(int layer_s) {
 			setPadOuPts(m_node_start, m_node_end, minClear, padPtr->box, 0, shape_out_direction[2], outDirectionsPts);
 		else {
 			cout << "Path [ " << m_curPathIndex << " ]:\t" << "no direction for startPad to rout!" << endl;
-			m_leafNodesList.emplace(m_node_start);
+			m_leafNodesList.push(m_node_start);
 		}
-		if (outDirectionsPts.empty()) {
+		if (outDirectionsPts.empty() && !m_searchingBackward) {
 			// No feasible exit points found for current pad
 			for (const auto& newSteinerNode : m_startNeibs) {
 				if (m_querySTChanged.contains(newSteinerNode->position)) continue;
@@ -453,7 +460,7 @@ void RouterMeshless::setStartPad(int layer_s) {
 		for (const int& layer : m_routingLayers) {
 			if (layer == layer_s) continue;
 			else if (m_startLayers.contains(layer)) {	// Search tree changes layer at pad center, actual path doesn't need to change layer
-				PathTree* newStartNode_inLayer = new PathTree(m_startPad->pos, layer, m_curNetName, nullptr);
+				PathTree* newStartNode_inLayer = newTreeNode(m_startPad->pos, layer, nullptr);
 				double estimateH = m_startPad->pos.distanceTo(m_endPad->pos);
 				double stepG = 0;
 				if (!m_startPad->shapes.contains(layer))
@@ -482,6 +489,7 @@ void RouterMeshless::setEndPad(int layer_e) {
 	int directionType = getPinPadOutDirection(m_node_end, padPtr);
 	double minClear = max(m_curNetInfo->clearance, padPtr->shapes[m_node_end->layer].clearance);
 	m_endExits.clear();
+	m_usableEndExits.clear();
 	if (directionType == 0)			// Circle, 8-direction extension
 		setPadOuPts(m_node_end, m_node_start, minClear, padPtr->box, 0, shape_out_direction[0], m_endExits);
 	else if (directionType == 1)	// Rectangle, up and down
@@ -494,19 +502,23 @@ void RouterMeshless::setEndPad(int layer_e) {
 		cout << "Path [ " << m_curPathIndex << " ]:\t" << "no direction for endPad to run!" << endl;
 	}
 }
-void RouterMeshless::setPadOuPts(PathTree* nodeToSet, PathTree* nodeToIgnore, double minClear, const vector<double>& box, int startIdx, int step, vector<Point>& outDirectionsPts) {
+void RouterMeshless::setPadOuPts(PathTree* nodeToSet, PathTree* nodeToIgnore, double minClear, const Box& box, int startIdx, int step, vector<Point>& outDirectionsPts) {
 	double lineWidth = m_curNetInfo->width / 2;
 	double width_x = (box[2] - box[0]) / 2 + minClear + m_viaRadius;		//m_viaRadius
 	double height_y = (box[3] - box[1]) / 2 + minClear + m_viaRadius;		//m_viaRadius
 	double max_xy = max(width_x, height_y);
 	vector<double> outLengths = { width_x ,max_xy, height_y ,max_xy ,width_x ,max_xy, height_y ,max_xy };
-	for (int i = startIdx; i < 8; i += step) {
-		const Point& d = Direction8[i];
-		Point targetPos = nodeToSet->pos + d * outLengths[i];
-		PinPad* nodeToSetPad = nullptr;
-		if (m_PinQuaryPad.contains(nodeToSet))
-			nodeToSetPad = m_PinQuaryPad[nodeToSet];
-		PolyShape* firstShape = getFirstShape(nodeToSet->pos, targetPos, nodeToSet->layer, nodeToSetPad);
+	PinPad* nodeToSetPad = nullptr;
+	if (m_PinQuaryPad.contains(nodeToSet))
+		nodeToSetPad = m_PinQuaryPad[nodeToSet];
+	vector<Point> targets;
+	for (int i = startIdx; i < 8; i += step)
+		targets.emplace_back(nodeToSet->pos + Direction8[i] * outLengths[i]);
+	vector<PolyShape*> firstShapes;
+	getFirstShapes(nodeToSet->pos, targets, nodeToSet->layer, nodeToSetPad, nullptr, firstShapes);
+	for (size_t k = 0; k < targets.size(); ++k) {
+		const Point& targetPos = targets[k];
+		PolyShape* firstShape = firstShapes[k];
 		bool canReach = false;
 		if (firstShape) {
 			PinPad* padEnd = getPadPtr(m_PinQuaryPad[nodeToIgnore]->shapeName);
@@ -525,7 +537,7 @@ void RouterMeshless::setPadOuPts(PathTree* nodeToSet, PathTree* nodeToIgnore, do
 int RouterMeshless::getPinPadOutDirection(PathTree* const nodeSE, PinPad*& padptr) {
 	// Get pad lead direction: 0-eight arbitrary directions, 1-vertical up-down, 2-horizontal left-right, 3-nearly square up-down-left-right
 	if (!m_PinQuaryPad.contains(nodeSE)) {
-		cout << "\tError! pinPad has no shape in net [" << nodeSE->netName << "]" << endl;
+		cout << "\tError! pinPad has no shape in net [" << m_curNetName << "]" << endl;
 		return -1;
 	}
 	const string& shapeName = m_PinQuaryPad[nodeSE]->shapeName;
@@ -567,7 +579,8 @@ bool RouterMeshless::changeStartOrEnd(bool isStart, PinPad* pad, int layer) {
 	}
 	m_querySTChanged.insert(itChange->second->position);
 	//2. Modify start and end point related information
-	PathTree newNode(pad->pos, layer, pad->netName, nullptr);
+	PathTree newNode(pad->pos, layer, m_curNetId, nullptr);
+	m_usableEndExits.clear();	// The ignored pads change
 	// Update pad and coordinate information of start or end point
 	if (isStart) {
 		m_node_start->copyIn(newNode);
@@ -670,20 +683,22 @@ bool RouterMeshless::runPPDT() {
 	// Execute planning point directed spanning tree search algorithm
 	bool pathFound = false;
 	//debugBreak(m_node_start);
-	while (!m_leafNodesList.empty()) {
-		//1 Select the optimal node
-		PathTree* minNode = nodeSelection();
-		//2 Explore and obtain target obstacle list
-		obssExploration(minNode);
-		//3 Expand child nodes
-		pathFound = nodeExpansion(minNode);
-		m_searchTimes++;
-		if (m_searchTimes > m_serchTimesLimit) {
-			cout << "time out!" << endl;
-			break;
+	double boardDiagonal = Point(m_bound[0], m_bound[1]).distanceTo(Point(m_bound[2], m_bound[3]));
+	if (m_bidirectionalFactor > 0 && m_node_start->pos.distanceTo(m_node_end->pos) > m_bidirectionalFactor * boardDiagonal)
+		pathFound = searchBidirectional();
+	else {
+		while (!m_leafNodesList.empty()) {
+			PathTree* minNode = nullptr;
+			pathFound = searchStep(minNode);
+			if (!minNode)		// Only via markers with nothing left to add were queued
+				break;
+			if (m_searchTimes > m_serchTimesLimit) {
+				cout << "time out!" << endl;
+				break;
+			}
+			if (pathFound)// Found path, exit loop
+				break;
 		}
-		if (pathFound)// Found path, exit loop
-			break;
 	}
 	//4 Backtrack and generate path
 	if (pathFound) {
@@ -699,6 +714,130 @@ bool RouterMeshless::runPPDT() {
 		cout << "Path[" << m_curPathIndex << "]\t" << "--> \trouting failed : " << m_node_start->pos << m_node_end->pos << endl;
 	return false;
 }
+bool RouterMeshless::searchStep(PathTree*& minNode) {
+	//1 Select the optimal node
+	minNode = nodeSelection();
+	if (!minNode)
+		return false;
+	//2 Explore and obtain target obstacle list
+	obssExploration(minNode);
+	//3 Expand child nodes
+	bool pathFound = nodeExpansion(minNode);
+	m_searchTimes++;
+	return pathFound;
+}
+bool RouterMeshless::searchBidirectional() {
+	// The trees of both pads take turns, a tree that reaches its own end or sees a node of the other tree ends the search
+	m_expandedNodes.clear();
+	setBackwardSearch();
+	bool pathFound = false;
+	bool sideDry[2] = { false, false };
+	PathTree* forwardNode = nullptr;
+	PathTree* backwardNode = nullptr;
+	while (!sideDry[0] || !sideDry[1]) {
+		int side = m_searchingBackward ? 1 : 0;
+		PathTree* minNode = nullptr;
+		bool reachedEnd = !m_leafNodesList.empty() && searchStep(minNode);
+		if (!minNode) {		// This tree cannot grow any more, the other one goes on alone
+			sideDry[side] = true;
+			swapSearchSide();
+			continue;
+		}
+		if (reachedEnd) {
+			pathFound = true;
+			if (m_searchingBackward)
+				backwardNode = m_node_end;		// Joined to the root of the forward tree
+			break;
+		}
+		PathTree* meetNode = findMeetingNode(minNode, m_otherSide.expandedNodes);
+		// Pad centers are only entered through the pad exits, they never join the trees
+		if (minNode->pos != m_startPad->pos && minNode->pos != m_endPad->pos)
+			m_expandedNodes.insert(minNode);
+		if (meetNode) {
+			pathFound = true;
+			forwardNode = m_searchingBackward ? meetNode : minNode;
+			backwardNode = m_searchingBackward ? minNode : meetNode;
+			break;
+		}
+		if (m_searchTimes > m_serchTimesLimit) {
+			cout << "time out!" << endl;
+			break;
+		}
+		if (!sideDry[1 - side])
+			swapSearchSide();
+	}
+	if (m_searchingBackward)
+		swapSearchSide();
+	if (backwardNode)
+		joinBackwardPath(forwardNode ? forwardNode : m_node_start, backwardNode);
+	return pathFound;
+}
+void RouterMeshless::setBackwardSearch() {
+	// Second tree rooted at the end pad and searching towards the start pad, it shares the arena of the forward tree
+	PathTree* forwardStart = m_node_start;
+	PathTree* forwardEnd = m_node_end;
+	swapSearchSide();
+	m_startPad = m_otherSide.endPad;
+	m_endPad = m_otherSide.startPad;
+	m_startNeibs = m_otherSide.endNeibs;
+	m_endNeibs = m_otherSide.startNeibs;
+	m_startLayers = m_otherSide.endLayers;
+	m_endLayers = m_otherSide.startLayers;
+	m_leafNodesList.clear();
+	m_exploredNodes.clear();
+	m_expandedNodes.clear();
+	m_node_start = newTreeNode(forwardEnd->pos, forwardEnd->layer, nullptr);
+	m_PinQuaryPad[m_node_start] = m_startPad;
+	m_node_end = newTreeNode(forwardStart->pos, forwardStart->layer, nullptr);
+	m_PinQuaryPad[m_node_end] = m_endPad;
+	m_pathTreesOrdered.emplace_back(m_node_start);
+	setStartPad(m_node_start->layer);
+	setEndPad(m_node_end->layer);
+	swapSearchSide();
+}
+void RouterMeshless::swapSearchSide() {
+	SearchSide& side = m_otherSide;
+	swap(m_node_start, side.nodeStart);
+	swap(m_node_end, side.nodeEnd);
+	swap(m_startPad, side.startPad);
+	swap(m_endPad, side.endPad);
+	swap(m_startNeibs, side.startNeibs);
+	swap(m_endNeibs, side.endNeibs);
+	swap(m_startLayers, side.startLayers);
+	swap(m_endLayers, side.endLayers);
+	swap(m_endExits, side.endExits);
+	swap(m_usableEndExits, side.usableEndExits);
+	swap(m_usableEndExitsVersion, side.usableEndExitsVersion);
+	swap(m_usableEndExitsFrom, side.usableEndExitsFrom);
+	swap(m_ptToEnd, side.ptToEnd);
+	swap(m_ptToEndCost, side.ptToEndCost);
+	swap(m_leafNodesList, side.leafNodesList);
+	swap(m_exploredNodes, side.exploredNodes);
+	swap(m_expandedNodes, side.expandedNodes);
+	m_searchingBackward = !m_searchingBackward;
+}
+PathTree* RouterMeshless::findMeetingNode(PathTree* node, const ExpandedNodeGrid& others) {
+	// The closest expanded nodes of the other tree on the same layer, pad centers are only entered through the pad exits
+	if (node->pos == m_startPad->pos || node->pos == m_endPad->pos)
+		return nullptr;
+	others.nearest(node->pos, node->layer, (size_t)m_meetTries, m_meetCandidates);
+	for (const auto& [dist, other] : m_meetCandidates) {
+		if (isReachable(node->pos, other->pos, node->layer, m_startPad, m_endPad))
+			return other;
+	}
+	return nullptr;
+}
+void RouterMeshless::joinBackwardPath(PathTree* node, PathTree* backNode) {
+	// Hang the backward path from backNode up to its root (the end pad) under node of the forward tree
+	PathTree* cur = node;
+	for (PathTree* back = backNode; back->parent; back = back->parent) {
+		if (back->pos == cur->pos && back->layer == cur->layer) continue;
+		PathTree* copy = newTreeNode(back->pos, back->layer, back->pNode);
+		cur->addChild(copy, cur->pos.distanceTo(back->pos), 0);
+		cur = copy;
+	}
+	cur->addChild(m_node_end, cur->pos.distanceTo(m_node_end->pos), 0);
+}
 bool RouterMeshless::route_GND() {
 	// Pad already grounded, no need for routing
 	bool startGotGnd = m_GNDConnected.find(m_node_start->pos) != m_GNDConnected.end();
@@ -725,12 +864,12 @@ bool RouterMeshless::route_GND() {
 		m_node_end->parent = nullptr;
 		bool alreadyGotGnd = startGotGnd || startInGndLayer || endGotGnd || endInGndLayer;
 		if (!alreadyGotGnd) {
-			PathTree* viaNode = m_leafNodesList.top();
+			PathTree* viaNode = nullptr;
 			double minCost = 999999999;
-			//1. Select the optimal via node (at start point)
-			while (!m_leafNodesList.empty()) {
-				PathTree* selectedNode = m_leafNodesList.top();
-				m_leafNodesList.pop();
+			//1. Select the optimal via node (at start point), the first leaf node if none is on the GND layer
+			while (PathTree* selectedNode = popLeafNode()) {
+				if (!viaNode)
+					viaNode = selectedNode;
 				if (selectedNode->layer == m_layerGND && selectedNode->g < minCost) {
 					minCost = selectedNode->g;
 					viaNode = selectedNode;
@@ -758,7 +897,8 @@ bool RouterMeshless::route_GND() {
 				PathTree* newNode = addOneChild(m_node_end, rst, m_node_end->layer, nullptr, false);
 				viaNode = addOneChild(newNode, rst, m_layerGND, nullptr, false);
 			}
-			backTrackOnePath(viaNode);
+			if (viaNode)
+				backTrackOnePath(viaNode);
 		}
 		m_GNDConnected.insert(m_node_start->pos);
 		m_GNDConnected.insert(m_node_end->pos);
@@ -770,17 +910,18 @@ bool RouterMeshless::route_GND() {
 		}
 		if (!startGotGnd && !startInGndLayer) {
 			// Start point not grounded
-			PathTree* viaNode = m_leafNodesList.top();
+			PathTree* viaNode = nullptr;
 			double minCost = 999999999;
-			while (!m_leafNodesList.empty()) {
-				PathTree* selectedNode = m_leafNodesList.top();
-				m_leafNodesList.pop();
+			while (PathTree* selectedNode = popLeafNode()) {
+				if (!viaNode)
+					viaNode = selectedNode;
 				if (selectedNode->layer == m_layerGND && selectedNode->g < minCost) {
 					minCost = selectedNode->g;
 					viaNode = selectedNode;
 				}
 			}
-			backTrackOnePath(viaNode);
+			if (viaNode)
+				backTrackOnePath(viaNode);
 			m_GNDConnected.insert(m_node_start->pos);
 		}
 		if (!endGotGnd && !endInGndLayer) {
@@ -833,10 +974,41 @@ bool RouterMeshless::isTreeGNDConnected(PathTree* node) {
 	}
 	return false;
 }
+const vector<Point>& RouterMeshless::getUsableEndExits(int layer) {
+	// Reachability of the exits only depends on the end point, the layer and the obstacles, not on the selected node
+	if (m_usableEndExitsVersion != m_gridManager->getVersion() || m_usableEndExitsFrom != m_node_end->pos) {
+		m_usableEndExits.clear();
+		m_usableEndExitsVersion = m_gridManager->getVersion();
+		m_usableEndExitsFrom = m_node_end->pos;
+	}
+	auto it = m_usableEndExits.find(layer);
+	if (it != m_usableEndExits.end())
+		return it->second;
+	vector<Point>& exits = m_usableEndExits[layer];
+	// All exits leave the end point, each layer is answered by one fan query
+	vector<PolyShape*> firstShapes;
+	getFirstShapes(m_node_end->pos, m_endExits, layer, m_startPad, m_endPad, firstShapes);
+	for (size_t i = 0; i < m_endExits.size(); ++i) {
+		if (isFreeOrPad(firstShapes[i], m_endPad, layer))
+			exits.emplace_back(m_endExits[i]);
+	}
+	if (!m_endLayers.contains(layer) && !exits.empty()) {
+		// The path also leaves the pad on the end layer before changing layer
+		getFirstShapes(m_node_end->pos, exits, m_node_end->layer, m_startPad, m_endPad, firstShapes);
+		size_t kept = 0;
+		for (size_t i = 0; i < exits.size(); ++i) {
+			if (isFreeOrPad(firstShapes[i], m_endPad, m_node_end->layer))
+				exits[kept++] = exits[i];
+		}
+		exits.resize(kept);
+	}
+	return exits;
+}
 PathTree* RouterMeshless::nodeSelection() {
 	//1. Select the optimal node from leaf nodes for expansion
-	PathTree* selectedNode = m_leafNodesList.top();
-	m_leafNodesList.pop();
+	PathTree* selectedNode = popLeafNode();
+	if (!selectedNode)
+		return nullptr;
 	//2. Select the optimal target node from end point exit points
 	m_ptToEnd = m_node_end->pos;
 	if (m_endExits.empty()) {
@@ -849,17 +1021,12 @@ PathTree* RouterMeshless::nodeSelection() {
 	int layer2 = m_node_end->layer;
 	if (layer1 > layer2)
 		swap(layer1, layer2);
-	//2.1 Exit points are sorted by selection cost from smallest to largest
+	//2.1 Rank the exit points reachable from the end point by selection cost
 	int tryTimes = 0;
-	multimap<double, Point> ptsToSelect;
 	while (tryTimes++ < 2) {
-		for (const auto& outPt : m_endExits) {
-			bool canReach = isReachable(m_node_end->pos, outPt, layer, m_startPad, m_endPad);
-			if (canReach) {
-				if (!m_endLayers.contains(layer))
-					canReach = isReachable(m_node_end->pos, outPt, m_node_end->layer, m_startPad, m_endPad);
-			}
-			if (!canReach) continue;
+		bool found = false;
+		double minCost = 0;
+		for (const auto& outPt : getUsableEndExits(layer)) {
 			// Calculate Manhattan distance
 			Point sTopt = outPt - pt_s;
 			double manhattanDistance = fabs(sTopt.x) + fabs(sTopt.y);
@@ -873,12 +1040,15 @@ PathTree* RouterMeshless::nodeSelection() {
 			}
 			// Calculate composite selection cost
 			double cost = manhattanDistance - smoothness * manhattanDistance * m_standardCostFactor;
-			ptsToSelect.insert(make_pair(cost, outPt));
+			//2.2 Select the point with the smallest cost as the target point
+			if (!found || cost < minCost) {
+				found = true;
+				minCost = cost;
+				m_ptToEnd = outPt;
+			}
 		}
-		//2.2 Select the point with the smallest cost (and reachable) as the target point
-		if (!ptsToSelect.empty()) {
-			m_ptToEndCost = ptsToSelect.begin()->first;
-			m_ptToEnd = ptsToSelect.begin()->second;
+		if (found) {
+			m_ptToEndCost = minCost;
 			break;
 		}
 		else {
@@ -892,73 +1062,16 @@ PathTree* RouterMeshless::nodeSelection() {
 	return selectedNode;
 }
 void RouterMeshless::obssExploration(const PathTree* start) {
-	//1. Get which cells are crossed
+	// Obstacles (pads, traces) of other nets blocking the line towards the end point, each once
 	const Line line(start->pos, m_ptToEnd);
-	vector<GridCell*> cells;
-	m_gridManager->getCellsAlongLine2(line, m_curNetInfo->width, cells);
-	//2. Get same-layer polygon obstacles in cells (may cross), deduplicate, remove polygon obstacles where endpoints are located
-	unordered_set<PolyShape*> obss;
-	getValidObssInCells(cells, line, start->layer, obss);
-	//3. Get intersecting obstacles (pads, traces)
-	getCandidateObss(obss, line);
-}
-void RouterMeshless::getCandidateObss(const unordered_set<PolyShape*>& obss, const Line& line) {
-	// Get intersecting obstacles (pads, traces)
-	for (PolyShape* shape : obss) {
-		if (shape->edges.empty()) continue;
-		if (shape->isLine) {
-			m_candidateObss.emplace(shape);
-		}
-		else {
-			for (auto& edge : shape->edges) {
-				Point pt1 = edge.p1->pos;
-				Point pt2 = edge.p2->pos;
-				Line shapeEdge(pt1, pt2);
-				double dist = line.distanceToLine(shapeEdge);
-				double minDist = m_curNetInfo->width / 2 + shape->clearance;  // max(m_curNetInfo->clearance, shape->clearance)
-				if (dist < minDist - MapMinValue) {
-					m_candidateObss.emplace(shape);
-					break;
-				}
-			}
-		}
-	}
-}
-void RouterMeshless::getValidObssInCells(const vector<GridCell*>& cells, const Line& line, int layer, unordered_set<PolyShape*>& obss) {
-	for (auto cell : cells) {
-		//1 Candidate linear obstacles, remove duplicates (traces)
-		for (auto& [pathline, shape] : cell->getPathLines()) {
-			if (pathline->layer != layer) continue;		// Ignore lines on different layers
-			if (pathline->p1->netName == m_curNetName) continue;
-			Line shapeEdge(pathline->p1->pos, pathline->p2->pos);
-			double dist = line.distanceToLine(shapeEdge);
-			double minDist = m_curNetInfo->width / 2 + pathline->width / 2 + max(m_curNetInfo->clearance, shape->clearance);
-			if (dist < minDist - MapMinValue) {
-				obss.insert(shape);
-				break;
-			}
-		}
-		//2 Candidate polygon obstacles (pads)
-		for (PinPad* pad : cell->getPinPads()) {
-			if (!pad->shapes.contains(layer)) continue;		// Ignore shapes on different layers
-			if (pad->netName == m_curNetName) continue;	// Ignore vias on this net
-			//if (pad == m_startPad || pad == m_endPad) continue;
-			PolyShape* obsShape = &pad->shapes[layer];
-			if (obss.find(obsShape) == obss.end()) {
-				if (abs(line.Pt1.x - line.Pt2.x) < MapMinValue) {
-					// Vertical line, use bounding box filter to remove polygons on left and right sides
-					if (pad->box[0] > line.Pt1.x || pad->box[2] < line.Pt1.x)
-						continue;
-				}
-				else if (abs(line.Pt1.y - line.Pt2.y) < MapMinValue) {
-					// Horizontal line, use bounding box filter to remove polygons on top and bottom sides
-					if (pad->box[1] > line.Pt1.y || pad->box[3] < line.Pt1.y)
-						continue;
-				}
-				obss.insert(obsShape);
-			}
-		}
-	}
+	ExplorationFilter filter;
+	filter.netId = m_curNetId;
+	filter.halfWidth = m_curNetInfo->width / 2;
+	filter.clearance = m_curNetInfo->clearance;
+	CollectAll result(m_query.shapes);
+	queryObstacles(*m_gridManager, m_query, line, m_curNetInfo->width, start->layer, filter, result);
+	for (PolyShape* shape : m_query.shapes)
+		m_candidateObss.emplace(shape);
 }
 bool RouterMeshless::nodeExpansion(PathTree* start) {
 	debugBreak(start);
@@ -995,19 +1108,19 @@ bool RouterMeshless::checkConnectToEnd(PathTree* start) {
 		if (newNode->layer == m_node_end->layer)				// Same layer, direct connection
 			newNode->addChild(m_node_end, m_ptToEndCost, 0);
 		else if (m_endLayers.contains(start->layer)) {			// Different layers, but allow layer change in place (end point includes this layer)
-			PathTree* newEndNode_inLayer = new PathTree(m_node_end->pos, newNode->layer, m_curNetName, nullptr);
+			PathTree* newEndNode_inLayer = newTreeNode(m_node_end->pos, newNode->layer, nullptr);
 			newNode->addChild(newEndNode_inLayer, m_ptToEndCost, 0);
 			newEndNode_inLayer->addChild(m_node_end, 0, 0);
 		}
 		else {			// Different layers, not allowed to change layer on-site (i.e., end pad doesn't contain this layer)
-			PathTree* newEndNode_inLayer = new PathTree(m_ptToEnd, m_node_end->layer, m_curNetName, nullptr);
+			PathTree* newEndNode_inLayer = newTreeNode(m_ptToEnd, m_node_end->layer, nullptr);
 			newNode->addChild(newEndNode_inLayer, stepG, 0);	// Layer change node
 			newEndNode_inLayer->addChild(m_node_end, 0, 0);
 		}
 		return true;
 	}
-	if (m_postOn && m_pinPairExchange) {
-		// Try to change end point
+	if (m_postOn && m_pinPairExchange && !m_searchingBackward) {
+		// Try to change end point, the backward search keeps the pads of the pin pair
 		PinPad* newPad = checkNewST(start, false);
 		if (newPad) {
 			changeStartOrEnd(false, newPad, start->layer);
@@ -1086,15 +1199,7 @@ bool RouterMeshless::connectToPos(PathTree* start, const Point& pos, PathNode* v
 	return true;
 }
 PathTree* RouterMeshless::posGetNode(const Point& pos, int layer) {
-	auto posIter = m_exploredNodes.find(pos);
-	if (posIter != m_exploredNodes.end()) {
-		const auto& layerMap = posIter->second;
-		auto layerIter = layerMap.find(layer);
-		if (layerIter != layerMap.end()) {
-			return layerIter->second;
-		}
-	}
-	return nullptr;
+	return m_exploredNodes.find(pos, layer);
 }
 bool RouterMeshless::getGHVia(PathTree* start, const Point& pos, int layer, double& G, double& H) {
 	if (start->layer == layer) {
@@ -1105,10 +1210,7 @@ bool RouterMeshless::getGHVia(PathTree* start, const Point& pos, int layer, doub
 		// Congestion cost
 		int obsSum = getCongestionSum(pos, m_viaRadius, start->layer, layer);
 		G = G + m_standartCost * obsSum * m_decayFactor;
-		if (m_endLayers.contains(layer))
-			H = pos.distanceTo(m_node_end->pos);
-		else
-			H = pos.distanceTo(m_node_end->pos) + m_standartCost;	// Via cost
+		H = estimateToEnd(pos, layer);
 		return false;	// Not via
 	}
 	else {
@@ -1120,21 +1222,29 @@ bool RouterMeshless::getGHVia(PathTree* start, const Point& pos, int layer, doub
 		}
 		int obsSum = getCongestionSum(pos, m_viaRadius, start->layer, layer);
 		G = G + m_standartCost * obsSum * m_decayFactor;
-		if (m_endLayers.contains(layer))
-			H = pos.distanceTo(m_node_end->pos);
-		else
-			H = pos.distanceTo(m_node_end->pos) + m_standartCost;	// Via cost
+		H = estimateToEnd(pos, layer);
 		return true;	// Is via
 	}
 
 }
+double RouterMeshless::estimateToEnd(const Point& pos, int layer) {
+	double dist = pos.distanceTo(m_node_end->pos);
+	if (m_endLayers.contains(layer))
+		return dist;
+	return dist + m_standartCost;	// Via cost
+}
 void RouterMeshless::updateExistingNode(PathTree* start, PathTree* oldNode, const double& G, const double& H) {
 	start->updateChild(oldNode);
-
-	// Update priority queue
-	// Not implemented yet
+	// Re-order the node and its lazy via marker if they are still waiting in the open list
+	m_leafNodesList.update(oldNode);
+	if (PathTree* marker = oldNode->viaMarker) {
+		marker->f = min(marker->f, viaMarkerBound(oldNode));
+		m_leafNodesList.update(marker);
+	}
 }
-PathTree* RouterMeshless::addOneChild(PathTree* start, const Point& pos, int layer, PathNode* vertexNode, bool allowVia) {
+PathTree* RouterMeshless::addOneChild(PathTree* start, const Point& rawPos, int layer, PathNode* vertexNode, bool allowVia) {
+	// Explored nodes are keyed by position, snapping merges copies of one corner computed along different routes
+	const Point pos = m_fixedGrid.snap(rawPos);
 	double G = 0, H = 0;
 	getGHVia(start, pos, layer, G, H);
 
@@ -1148,55 +1258,98 @@ PathTree* RouterMeshless::addOneChild(PathTree* start, const Point& pos, int lay
 	}
 
 	// New node
-	PathTree* newNode = new PathTree(pos, layer, start->netName, vertexNode);
-	m_exploredNodes[pos].insert({ layer, newNode });
+	PathTree* newNode = newTreeNode(pos, layer, vertexNode);
+	m_exploredNodes.insert(pos, layer, newNode);
 	start->addChild(newNode, G, H);
 	nodeOptimaze(newNode);
-	m_leafNodesList.emplace(newNode);
+	m_leafNodesList.push(newNode);
 
 	// Via expansion (Note: only for "new nodes")
 	if (allowVia && start->pos.distanceTo(pos) > m_pathViaMinLength) {
-		for (int otherLayer : m_routingLayers) {
-			if (otherLayer == layer) continue;
-			double viaG = 0, viaH = 0;
-			getGHVia(newNode, pos, otherLayer, viaG, viaH);
-			if (posGetNode(pos, otherLayer))
-				continue;
-			PathTree* viaNode = new PathTree(pos, otherLayer, start->netName, nullptr);
-			m_exploredNodes[pos].insert({ otherLayer, viaNode });
-			newNode->addChild(viaNode, viaG, viaH);
-			nodeOptimaze(viaNode);
-			m_leafNodesList.emplace(viaNode);
-		}
+		if (m_lazyViaLayers > 0 && (int)m_routingLayers.size() >= m_lazyViaLayers)
+			pushViaMarker(newNode);
+		else
+			addViaChildren(newNode);
 	}
 
 	return newNode;
 }
+void RouterMeshless::addViaChildren(PathTree* node) {
+	// Via nodes at the position of node on every other routing layer
+	for (int otherLayer : m_routingLayers) {
+		if (otherLayer == node->layer) continue;
+		if (posGetNode(node->pos, otherLayer))
+			continue;
+		double viaG = 0, viaH = 0;
+		getGHVia(node, node->pos, otherLayer, viaG, viaH);
+		PathTree* viaNode = newTreeNode(node->pos, otherLayer, nullptr);
+		m_exploredNodes.insert(node->pos, otherLayer, viaNode);
+		node->addChild(viaNode, viaG, viaH);
+		nodeOptimaze(viaNode);
+		m_leafNodesList.push(viaNode);
+	}
+}
+void RouterMeshless::pushViaMarker(PathTree* node) {
+	// One queued marker instead of one queued node per layer, the layers are priced when the marker is popped
+	double bound = viaMarkerBound(node);
+	if (bound == numeric_limits<double>::max()) return;
+	PathTree* marker = newTreeNode(node->pos, node->layer, nullptr);	// Not part of the tree
+	marker->viaSource = node;
+	marker->f = bound;
+	node->viaMarker = marker;
+	m_leafNodesList.push(marker);
+}
+double RouterMeshless::viaMarkerBound(PathTree* node) {
+	// f of the cheapest via child without its congestion cost, getGHVia and addChild add that on top
+	double bestH = numeric_limits<double>::max();
+	for (int otherLayer : m_routingLayers) {
+		if (otherLayer == node->layer) continue;
+		if (posGetNode(node->pos, otherLayer))
+			continue;
+		bestH = min(bestH, estimateToEnd(node->pos, otherLayer));
+	}
+	if (bestH == numeric_limits<double>::max()) return bestH;
+	double viaG = node->g + m_standartCost;
+	return node->g + viaG + bestH;
+}
+PathTree* RouterMeshless::popLeafNode() {
+	// Next node of the open list, lazy via markers are replaced by the via nodes they stand for
+	while (!m_leafNodesList.empty()) {
+		PathTree* node = m_leafNodesList.top();
+		m_leafNodesList.pop();
+		if (!node->viaSource)
+			return node;
+		node->viaSource->viaMarker = nullptr;
+		addViaChildren(node->viaSource);
+	}
+	return nullptr;
+}
 int RouterMeshless::getCongestionSum(const Point& pos, double r, int layer1, int layer2 = -1) const {
 	if (layer1 > layer2)
 		swap(layer1, layer2);
-	vector<GridCell*> cells;
 	double minDistance = r + m_curNetInfo->clearance;
+	// The same positions are priced again and again, samples stay valid until a pad nearby changes
+	CongestionField::Key key = CongestionField::makeKey(pos, layer1, layer2, m_curNetId, minDistance);
+	int cached = 0;
+	if (m_congestion.find(key, cached))
+		return cached;
+	m_query.begin(*m_gridManager);
+	vector<GridCell*>& cells = m_query.cells;
 	double viaBound0 = pos.x - minDistance;
 	double viaBound1 = pos.y - minDistance;
 	double viaBound2 = pos.x + minDistance;
 	double viaBound3 = pos.y + minDistance;
-	m_gridManager->getCellsInBox(vector<double>{viaBound0, viaBound1, viaBound2, viaBound3}, cells);
 	int obsSum = 0;
-	for (auto cell : cells) {
-		//2.1 Polygon obstacles (pads)
-		for (PinPad* pad : cell->getPinPads()) {
-			if (pad->netName == m_curNetName) continue;
-			if (pad->box[0] > viaBound2 || pad->box[2] < viaBound0 || pad->box[1] > viaBound3 || pad->box[3] < viaBound1)
-				continue;
-			PolyShape* obsShape = nullptr;
-			for (auto& [layer, shape] : pad->shapes) {
-				if (layer >= layer1 && layer <= layer2) {
-					obsShape = &shape;	// Find the shape of the layer through which the via passes
-					break;
-				}
-			}
-			if (obsShape) {
+	int maxLayer = min(layer2, m_gridManager->getMaxLayer());
+	for (int layer = max(layer1, 0); layer <= maxLayer; ++layer) {
+		m_gridManager->getCellsNearPoint(pos, minDistance, layer, cells);
+		for (auto cell : cells) {
+			//2.1 Polygon obstacles (pads), a pad spanning several layers is counted on its lowest layer in range
+			for (const GridPad& gp : cell->getPinPads()) {
+				if (gp.netId == m_curNetId || gp.lowestLayerIn(layer1, layer2) != layer) continue;
+				if (gp.box[0] > viaBound2 || gp.box[2] < viaBound0 || gp.box[1] > viaBound3 || gp.box[3] < viaBound1)
+					continue;
+				PolyShape* obsShape = &gp.pad->shapes[layer];	// The shape of the layer through which the via passes
 				// Find the nearest edge
 				for (auto& edge : obsShape->edges) {
 					double dist = pos.distanceToEdge(edge.p1->pos, edge.p2->pos);
@@ -1207,6 +1360,7 @@ int RouterMeshless::getCongestionSum(const Point& pos, double r, int layer1, int
 			}
 		}
 	}
+	m_congestion.store(key, obsSum, minDistance);
 	return obsSum;//obsSum > 0 ? obsSum - 1 : obsSum
 }
 void RouterMeshless::nodeOptimaze(PathTree* node) {
@@ -1242,83 +1396,16 @@ void RouterMeshless::nodeOptimaze(PathTree* node) {
 	}
 }
 PolyShape* RouterMeshless::getFirstShape2(const Point& p1, const Point& p2, int layer, PinPad* ignorePad2) {
-	//1. Get which cells are crossed
-	vector<GridCell*> cells;
 	Line line(p1, p2);
-	m_gridManager->getCellsAlongLine2(line, m_curNetInfo->width, cells);
-	unordered_set<PolyShape*> obss;
-
-	//2. Get same-layer obstacles in cells (may cross), remove duplicates and obstacles at endpoints
 	const NetInfo& netInfo = m_netsInfos->at(m_curNetName);
-	double halfLineWidth = netInfo.width / 2;
-	for (auto cell : cells) {
-		for (PinPad* pad : cell->getPinPads()) {
-			if (!pad->shapes.contains(layer)) continue;		// Pad not on this layer
-			if (pad->netName == m_curNetName) continue;		// Ignore vias on this net
-			if (ignorePad2 && pad == ignorePad2) continue;
-			PolyShape* curShape = &pad->shapes[layer];
-			if (!obss.contains(curShape)) {
-				double distToIgnore = halfLineWidth + max(netInfo.clearance, curShape->clearance);
-				if (abs(line.Pt1.x - line.Pt2.x) < MapMinValue) {
-					// Vertical line, use bounding box filter to remove polygons on left and right sides
-					if (pad->box[0] > line.Pt1.x + distToIgnore || pad->box[2] < line.Pt1.x - distToIgnore)
-						continue;
-				}
-				else if (abs(line.Pt1.y - line.Pt2.y) < MapMinValue) {
-					// Horizontal line, use bounding box filter to remove polygons on top and bottom sides
-					if (pad->box[1] > line.Pt1.y + distToIgnore || pad->box[3] < line.Pt1.y - distToIgnore)
-						continue;
-				}
-				obss.insert(curShape);
-			}
-		}
-	}
-
-	//3. Get intersecting obstacles (polygon pad obstacles)
-	double nearistObsDist = line.getLength();
-	PolyShape* firstObs = nullptr;
-	for (PolyShape* shape : obss) {
-		if (shape->edges.empty()) continue;
-		for (auto& edge : shape->edges) {
-			Point pt1 = edge.p1->pos;
-			Point pt2 = edge.p2->pos;
-			Line shapeEdge(pt1, pt2);
-			double minDist = halfLineWidth + max(netInfo.clearance, shape->clearance);    // Minimum allowed distance
-			double dist = line.distanceToLine(shapeEdge);        // Distance from exploration line to obstacle
-			if (dist < minDist - MapMinValue) {    // Blocked
-				Point crossingPoint = line.getCrossingPoint(shapeEdge);
-				double startPtToObsDist = line.Pt1.distanceTo(crossingPoint);
-				if (startPtToObsDist < nearistObsDist) {
-					nearistObsDist = startPtToObsDist;
-					firstObs = shape;
-				}
-			}
-		}
-	}
-
-	//4. Get intersecting obstacles (linear obstacles)
-	for (auto cell : cells) {
-		for (auto& [pathline, shape] : cell->getPathLines()) {
-			if (pathline->layer != layer) continue;        // Ignore lines on different layers
-			// Linear obstacles under the same net
-			if (pathline->p1->netName == m_curNetName) continue;
-
-			Line shapeEdge(pathline->p1->pos, pathline->p2->pos);
-			double dist = line.distanceToLine(shapeEdge);
-			double minDist = netInfo.width / 2 + pathline->width / 2 + max(netInfo.clearance, shape->clearance);
-			if (dist < minDist - MapMinValue) {
-				Point crossingPoint = line.getCrossingPoint(shapeEdge);
-				double startPtToObsDist = line.Pt1.distanceTo(crossingPoint);
-				double startPtToObsDist2 = line.Pt1.distanceToEdge(pathline->p1->pos, pathline->p2->pos);
-				if (startPtToObsDist2 < nearistObsDist) {
-					nearistObsDist = startPtToObsDist;
-					firstObs = shape;
-				}
-			}
-		}
-	}
-
-	return firstObs;
+	OtherNetsFilter filter;
+	filter.netId = m_curNetId;
+	filter.halfWidth = netInfo.width / 2;
+	filter.clearance = netInfo.clearance;
+	filter.ignorePad2 = ignorePad2;
+	FirstHit result(line.getLength());
+	queryObstacles(*m_gridManager, m_query, line, m_curNetInfo->width, layer, filter, result);
+	return result.shape;
 }
 bool RouterMeshless::isReachable2(const Point& p1, const Point& p2, int layer, PinPad* ignorePad2, PolyShape** firstObsPtr) {
 	// Get the first obstacle from start to end point
@@ -1330,154 +1417,77 @@ bool RouterMeshless::isReachable2(const Point& p1, const Point& p2, int layer, P
 	return (!obs || (ignorePad2 && ignorePad2->shapes.contains(layer) && obs == &ignorePad2->shapes[layer]));
 }
 PolyShape* RouterMeshless::getFirstShape(const Point& p1, const Point& p2, int layer, PinPad* ignorePad, PinPad* ignorePad2) {
-	//1. Get which cells are crossed
-	vector<GridCell*> cells;
-	Line line(p1, p2);
-	m_gridManager->getCellsAlongLine2(line, m_curNetInfo->width, cells);
-	unordered_set<PolyShape*> obss;
+	// The same segments are asked again and again during one search
+	ReachabilityCache::Key key = ReachabilityCache::makeKey(p1, p2, layer, m_curNetId, m_curNetInfo->width, m_curNetInfo->clearance, ignorePad, ignorePad2);
+	PolyShape* firstObs = nullptr;
+	if (m_reachCache.find(key, firstObs))
+		return firstObs;
 
-	//2. Get same-layer obstacles in cells (may cross), deduplicate, remove obstacles where endpoints are located
+	Line line(p1, p2);
 	double halfLineWidth = m_curNetInfo->width / 2;
-	for (auto cell : cells) {
-		for (PinPad* pad : cell->getPinPads()) {
-			if (!pad->shapes.contains(layer)) continue;		// Pad not on this layer
-			if (pad->netName == m_curNetName) continue;		// Ignore vias on this net
-			if (ignorePad && pad == ignorePad) continue;	// Ignore this pad
-			if (ignorePad2 && pad == ignorePad2) continue;
-			PolyShape* curShape = &pad->shapes[layer];
-			if (!obss.contains(curShape)) {
-				double distToIgnore = halfLineWidth + max(m_curNetInfo->clearance, curShape->clearance);
-				if (abs(line.Pt1.x - line.Pt2.x) < MapMinValue) {
-					// Vertical line, use bounding box filter to remove polygons on left and right sides
-					if (pad->box[0] > line.Pt1.x + distToIgnore || pad->box[2] < line.Pt1.x - distToIgnore)
-						continue;
-				}
-				else if (abs(line.Pt1.y - line.Pt2.y) < MapMinValue) {
-					// Horizontal line, use bounding box filter to remove polygons on top and bottom sides
-					if (pad->box[1] > line.Pt1.y + distToIgnore || pad->box[3] < line.Pt1.y - distToIgnore)
-						continue;
-				}
-				obss.insert(curShape);
-			}
-		}
-	}
+	ExplorationFilter filter;
+	filter.netId = m_curNetId;
+	filter.halfWidth = halfLineWidth;
+	filter.clearance = m_curNetInfo->clearance;
+	filter.ignorePad1 = ignorePad;
+	filter.ignorePad2 = ignorePad2;
+	FirstHit result(line.getLength() + halfLineWidth * 2 + m_curNetInfo->clearance);
+	queryObstacles(*m_gridManager, m_query, line, m_curNetInfo->width, layer, filter, result);
+	m_reachCache.store(key, result.shape);
+	return result.shape;
+}
+void RouterMeshless::getFirstShapes(const Point& origin, const vector<Point>& targets, int layer, PinPad* ignorePad, PinPad* ignorePad2, vector<PolyShape*>& firstShapes) {
+	firstShapes.assign(targets.size(), nullptr);
+	vector<size_t> missing;
+	vector<Point> missingTargets;
+	vector<ReachabilityCache::Key> keys(targets.size());
+	for (size_t i = 0; i < targets.size(); ++i) {
+		keys[i] = ReachabilityCache::makeKey(origin, targets[i], layer, m_curNetId, m_curNetInfo->width, m_curNetInfo->clearance, ignorePad, ignorePad2);
+		if (!m_reachCache.find(keys[i], firstShapes[i])) {
+			missing.push_back(i);
+			missingTargets.push_back(targets[i]);
+		}
+	}
+	if (missing.empty()) return;
 
-	//3. Get intersecting obstacles (polygon pad obstacles)
-	double nearistObsDist = line.getLength() + halfLineWidth * 2 + m_curNetInfo->clearance;
-	PolyShape* firstObs = nullptr;
-	for (PolyShape* shape : obss) {
-		if (shape->edges.empty()) continue;
-		double minDist = halfLineWidth + shape->clearance;    // Minimum allowed distance max(m_curNetInfo->clearance, shape->clearance)
-		for (auto& edge : shape->edges) {
-			Point pt1 = edge.p1->pos;
-			Point pt2 = edge.p2->pos;
-			Line shapeEdge(pt1, pt2);
-			double dist = line.distanceToLine(shapeEdge);        // Distance from exploration line to obstacle
-			if (dist < minDist - MapMinValue) {    // Blocked
-				Point crossingPoint = line.getCrossingPoint(shapeEdge);
-				double startPtToObsDist = line.Pt1.distanceTo(crossingPoint);
-				if (startPtToObsDist < nearistObsDist) {
-					nearistObsDist = startPtToObsDist;
-					firstObs = shape;
-				}
-			}
-		}
-	}
-
-	//4. Get intersecting obstacles (linear obstacles)
-	for (auto cell : cells) {
-		for (auto& [pathline, shape] : cell->getPathLines()) {
-			if (pathline->layer != layer) continue;        // Ignore lines on different layers
-			// Linear obstacles under the same net
-			if (pathline->p1->netName == m_curNetName) continue;
-
-			Line shapeEdge(pathline->p1->pos, pathline->p2->pos);
-			double dist = line.distanceToLine(shapeEdge);
-			double minDist = m_curNetInfo->width / 2 + pathline->width / 2 + max(m_curNetInfo->clearance, shape->clearance);
-			if (dist < minDist - MapMinValue) {
-				Point crossingPoint = line.getCrossingPoint(shapeEdge);
-				double startPtToObsDist = line.Pt1.distanceTo(crossingPoint);
-				double startPtToObsDist2 = line.Pt1.distanceToEdge(pathline->p1->pos, pathline->p2->pos);
-				if (startPtToObsDist2 < nearistObsDist) {
-					nearistObsDist = startPtToObsDist;
-					firstObs = shape;
-				}
-			}
-		}
+	double halfLineWidth = m_curNetInfo->width / 2;
+	ExplorationFilter filter;
+	filter.netId = m_curNetId;
+	filter.halfWidth = halfLineWidth;
+	filter.clearance = m_curNetInfo->clearance;
+	filter.ignorePad1 = ignorePad;
+	filter.ignorePad2 = ignorePad2;
+	vector<FirstHit> results;
+	results.reserve(missing.size());
+	for (const Point& target : missingTargets)
+		results.emplace_back(origin.distanceTo(target) + halfLineWidth * 2 + m_curNetInfo->clearance);
+	queryObstacleFan(*m_gridManager, m_query, origin, missingTargets, m_curNetInfo->width, layer, filter, results);
+	for (size_t j = 0; j < missing.size(); ++j) {
+		firstShapes[missing[j]] = results[j].shape;
+		m_reachCache.store(keys[missing[j]], results[j].shape);
 	}
-	return firstObs;
 }
 bool RouterMeshless::isReachable(const Point& p1, const Point& p2, int layer, PinPad* ignorePad1, PinPad* ignorePad2, PolyShape** firstObsPtr) {
 	// Get the first obstacle from start to end point
 	PolyShape* obs = getFirstShape(p1, p2, layer, ignorePad1, ignorePad2);
 	if (firstObsPtr)
 		*firstObsPtr = obs;
-	// If there are no obstacles, or the obstacle is ignorePad2 (end point pad), then it is reachable
-	return (!obs || (ignorePad2 && ignorePad2->shapes.contains(layer) && obs == &ignorePad2->shapes[layer]));
+	return isFreeOrPad(obs, ignorePad2, layer);
+}
+bool RouterMeshless::isFreeOrPad(PolyShape* firstObs, PinPad* pad, int layer) {
+	// If there are no obstacles, or the obstacle is pad (end point pad), then it is reachable
+	return (!firstObs || (pad && pad->shapes.contains(layer) && firstObs == &pad->shapes[layer]));
 }
 bool RouterMeshless::checkPushLine(PathNode* M, PathNode* N, const Point pushVec) {
-	Point p1 = M->pos + pushVec;
-	Point p2 = N->pos + pushVec;
-	int layer = N->layer;
-	//1. Get which cells are crossed
-	vector<GridCell*> cells;
-	Line line(p1, p2);
-	m_gridManager->getCellsAlongLine2(line, m_curNetInfo->width, cells);
-	unordered_set<PolyShape*> obss;
-	//2. Get same-layer obstacles in cells (may cross), deduplicate, remove obstacles where endpoints are located
+	Line line(M->pos + pushVec, N->pos + pushVec);
 	const NetInfo& netInfo = m_netsInfos->at(M->netName);
-	double halfLineWidth = netInfo.width / 2;
-	for (auto cell : cells) {
-		for (PinPad* pad : cell->getPinPads()) {
-			if (!pad->shapes.contains(layer)) continue;		// Pad not on this layer
-			if (pad->netName == M->netName) continue;		// Ignore vias on this net
-			PolyShape* curShape = &pad->shapes[layer];
-			if (!obss.contains(curShape)) {
-				double distToIgnore = halfLineWidth + max(netInfo.clearance, curShape->clearance);
-				if (abs(line.Pt1.x - line.Pt2.x) < MapMinValue) {
-					// Vertical line, use bounding box filter to remove polygons on left and right sides
-					if (pad->box[0] > line.Pt1.x + distToIgnore || pad->box[2] < line.Pt1.x - distToIgnore)
-						continue;
-				}
-				else if (abs(line.Pt1.y - line.Pt2.y) < MapMinValue) {
-					// Horizontal line, use bounding box filter to remove polygons on top and bottom sides
-					if (pad->box[1] > line.Pt1.y + distToIgnore || pad->box[3] < line.Pt1.y - distToIgnore)
-						continue;
-				}
-				obss.insert(curShape);
-			}
-		}
-	}
-	//3. Get intersecting obstacles (polygon pad obstacles)
-	double nearistObsDist = line.getLength();
-	for (PolyShape* shape : obss) {
-		if (shape->edges.empty()) continue;
-		for (auto& edge : shape->edges) {
-			Point pt1 = edge.p1->pos;
-			Point pt2 = edge.p2->pos;
-			Line shapeEdge(pt1, pt2);
-			double minDist = halfLineWidth + max(netInfo.clearance, shape->clearance);    // Minimum allowed distance
-			double dist = line.distanceToLine(shapeEdge);        // Distance from exploration line to obstacle
-			if (dist < minDist - MapMinValue) {    // Blocked
-				return false;
-			}
-		}
-	}
-	//4. Get intersecting obstacles (linear obstacles)
-	for (auto cell : cells) {
-		for (auto& [pathline, shape] : cell->getPathLines()) {
-			if (pathline->layer != layer) continue;        // Ignore lines on different layers
-			// Linear obstacles under the same net
-			if (pathline->p1->netName == M->netName) continue;
-			Line shapeEdge(pathline->p1->pos, pathline->p2->pos);
-			double dist = line.distanceToLine(shapeEdge);
-			double minDist = netInfo.width / 2 + pathline->width / 2 + max(netInfo.clearance, shape->clearance);
-			if (dist < minDist - MapMinValue) {
-				return false;
-			}
-		}
-	}
-	return true;
+	OtherNetsFilter filter;
+	filter.netId = m_gridManager->getNetId(M->netName);
+	filter.halfWidth = netInfo.width / 2;
+	filter.clearance = netInfo.clearance;
+	AnyHit result;
+	queryObstacles(*m_gridManager, m_query, line, m_curNetInfo->width, N->layer, filter, result);
+	return !result.hit;
 }
 void RouterMeshless::setSEViasNode(PathNode* head, PathNode* tail) {
 	// Path must have at least three nodes to determine via position
@@ -1557,9 +1567,11 @@ void RouterMeshless::insertOneVia(PathNode* viaPre) {
 	for (int i = layer1; i <= layer2; i++) {
 		onePad.addShape(i, m_viaRadius, { 0,0 });
 	}
-	m_gridManager->addPinPad(&onePad);
+	addPadToGrid(&onePad);
 }
 bool RouterMeshless::checkViaPos(const Point& pos, int layer1, int layer2) {
+	if (isViaSiteFree(pos, layer1, layer2))
+		return true;
 	bool canVia = true;
 	vector<GridCell*> cells;
 	double minDistance = m_viaRadius + m_curNetInfo->clearance;
@@ -1567,54 +1579,39 @@ bool RouterMeshless::checkViaPos(const Point& pos, int layer1, int layer2) {
 	double viaBound1 = pos.y - minDistance;
 	double viaBound2 = pos.x + minDistance;
 	double viaBound3 = pos.y + minDistance;
-	m_gridManager->getCellsInBox(vector<double>{viaBound0, viaBound1, viaBound2, viaBound3}, cells);
-	for (auto cell : cells) {
-		//2.2 Candidate line obstacles (traces)
-		int pushTimies = 0;
-		bool tryPushLine = true;
-		while (tryPushLine) {
-			canVia = true;
-			if (pushTimies++ > 5)
-				break;
-			tryPushLine = false;
-			std::vector<std::pair<PathLine*, PolyShape*>> pathLinesSnapshot;
-			pathLinesSnapshot.reserve(cell->getPathLines().size());
-			for (auto& kv : cell->getPathLines()) {
-				pathLinesSnapshot.emplace_back(kv);
-			}
-			for (auto& [pathline, shape] : pathLinesSnapshot) {
-				if (!pathline || !shape) continue;
-				if (pathline->layer < layer1 || pathline->layer > layer2) continue;     // Ignore lines on different layers
-				if (pathline->p1->netName == m_curNetName) continue;                    // Linear obstacles under the same net
-				double dist = pos.distanceToEdge(pathline->p1->pos, pathline->p2->pos);
-				double minDist = m_viaRadius + pathline->width / 2 + max(m_curNetInfo->clearance, shape->clearance);
-				if (dist < minDist - MapMinValue) {
-					if (m_viaPush) {
-						canVia = false;
-						PathNode* M = pathline->p1, * N = pathline->p2;
-						while (N && N->pos == M->pos) N = N->next;
-						if (!N || M->pos == N->pos) continue;
-						Point pushVec = (M->pos - N->pos).rotate90().normalizeVec() * (minDist - dist);
-						double distance1 = pos.distanceToEdge(M->pos + pushVec, N->pos + pushVec);
-						double distance2 = pos.distanceToEdge(M->pos - pushVec, N->pos - pushVec);
-						if (distance1 < distance2)
-							pushVec = pushVec * (-1);
-						bool canReach = checkPushLine(M, N, pushVec);
-						if (canReach) {
-							removeOnePathFromGrid(shape);
-							PathNode* start = shape->edges.front().p1;
-							PathNode* end = shape->edges.back().p2;
-							removeVias(start, end);
-							pushMoveLine(M, pushVec, shape);
-							if (shape && !shape->edges.empty())
-								addOnePathToGrid(shape);
-							m_gridManager->getCellsInBox(vector<double>{viaBound0, viaBound1, viaBound2, viaBound3}, cells);
-							resetVias(start, end);
-							tryPushLine = true;
-						}
-						else {
-							pushVec = pushVec * (-1);
-							canReach = checkPushLine(M, N, pushVec);
+	int maxLayer = min(layer2, m_gridManager->getMaxLayer());
+	for (int layer = max(layer1, 0); layer <= maxLayer; ++layer) {
+		m_gridManager->getCellsNearPoint(pos, minDistance, layer, cells);
+		for (size_t cellIndex = 0; cellIndex < cells.size(); ++cellIndex) {	// cells is refreshed after a push
+			GridCell* cell = cells[cellIndex];
+			//2.2 Candidate line obstacles (traces)
+			int pushTimies = 0;
+			bool tryPushLine = true;
+			while (tryPushLine) {
+				canVia = true;
+				if (pushTimies++ > 5)
+					break;
+				tryPushLine = false;
+				std::vector<GridSegment> pathLinesSnapshot = cell->getPathLines();	// Pushing lines modifies the cell
+				for (const GridSegment& seg : pathLinesSnapshot) {
+					PathLine* pathline = seg.line;
+					PolyShape* shape = seg.shape;
+					if (!pathline || !shape) continue;
+					if (seg.netId == m_curNetId) continue;                    // Linear obstacles under the same net
+					double dist = Segment(seg.p1, seg.p2).distanceTo(pos);
+					double minDist = m_viaRadius + seg.halfWidth + max(m_curNetInfo->clearance, shape->clearance);
+					if (dist < minDist - MapMinValue) {
+						if (m_viaPush) {
+							canVia = false;
+							PathNode* M = pathline->p1, * N = pathline->p2;
+							while (N && N->pos == M->pos) N = N->next;
+							if (!N || M->pos == N->pos) continue;
+							Point pushVec = (M->pos - N->pos).rotate90().normalizeVec() * (minDist - dist);
+							double distance1 = pos.distanceToEdge(M->pos + pushVec, N->pos + pushVec);
+							double distance2 = pos.distanceToEdge(M->pos - pushVec, N->pos - pushVec);
+							if (distance1 < distance2)
+								pushVec = pushVec * (-1);
+							bool canReach = checkPushLine(M, N, pushVec);
 							if (canReach) {
 								removeOnePathFromGrid(shape);
 								PathNode* start = shape->edges.front().p1;
@@ -1623,34 +1620,42 @@ bool RouterMeshless::checkViaPos(const Point& pos, int layer1, int layer2) {
 								pushMoveLine(M, pushVec, shape);
 								if (shape && !shape->edges.empty())
 									addOnePathToGrid(shape);
-								m_gridManager->getCellsInBox(vector<double>{viaBound0, viaBound1, viaBound2, viaBound3}, cells);
+								m_gridManager->getCellsNearPoint(pos, minDistance, layer, cells);
 								resetVias(start, end);
 								tryPushLine = true;
 							}
+							else {
+								pushVec = pushVec * (-1);
+								canReach = checkPushLine(M, N, pushVec);
+								if (canReach) {
+									removeOnePathFromGrid(shape);
+									PathNode* start = shape->edges.front().p1;
+									PathNode* end = shape->edges.back().p2;
+									removeVias(start, end);
+									pushMoveLine(M, pushVec, shape);
+									if (shape && !shape->edges.empty())
+										addOnePathToGrid(shape);
+									m_gridManager->getCellsNearPoint(pos, minDistance, layer, cells);
+									resetVias(start, end);
+									tryPushLine = true;
+								}
+							}
+							if (tryPushLine)
+								break;
+						}
+						else {
+							return false;
 						}
-						if (tryPushLine)
-							break;
-					}
-					else {
-						return false;
 					}
 				}
 			}
-		}
-		//2.1 Polygon obstacles (pads)
-		for (PinPad* pad : cell->getPinPads()) {
-			if (pad->box[0] > viaBound2 || pad->box[2] < viaBound0 || pad->box[1] > viaBound3 || pad->box[3] < viaBound1)
-				continue;
-			if (pad->netName == m_curNetName)
-				continue;
-			PolyShape* obsShape = nullptr;
-			for (auto& [layer, shape] : pad->shapes) {
-				if (layer >= layer1 && layer <= layer2) {
-					obsShape = &shape;	// Find the shape of the layer through which the via passes
-					break;
-				}
-			}
-			if (obsShape) {
+			//2.1 Polygon obstacles (pads)
+			for (const GridPad& gp : cell->getPinPads()) {
+				if (gp.box[0] > viaBound2 || gp.box[2] < viaBound0 || gp.box[1] > viaBound3 || gp.box[3] < viaBound1)
+					continue;
+				if (gp.netId == m_curNetId)
+					continue;
+				PolyShape* obsShape = &gp.pad->shapes[layer];	// The shape of the layer through which the via passes
 				// Find the nearest edge
 				for (auto& edge : obsShape->edges) {
 					double dist = pos.distanceToEdge(edge.p1->pos, edge.p2->pos);
@@ -1663,6 +1668,72 @@ bool RouterMeshless::checkViaPos(const Point& pos, int layer1, int layer2) {
 	}
 	return canVia;
 }
+bool RouterMeshless::isViaSiteFree(const Point& pos, int layer1, int layer2) {
+	if (layer1 > layer2)
+		swap(layer1, layer2);
+	m_viaSites.sync(m_curNetId, m_viaRadius + m_curNetInfo->clearance, m_viaRadius / 2);
+	ViaSiteMap::Site site = m_viaSites.find(pos, layer1, layer2);
+	if (site == ViaSiteMap::Site::Unknown) {
+		bool free = isViaClear(m_viaSites.cellCenter(pos), layer1, layer2, m_viaSites.margin());
+		m_viaSites.store(pos, layer1, layer2, free);
+		return free;
+	}
+	return site == ViaSiteMap::Site::Free;
+}
+bool RouterMeshless::getNearestViaSite(const Point& pos, double radius, int layer1, int layer2, Point& site) {
+	if (layer1 > layer2)
+		swap(layer1, layer2);
+	m_viaSites.sync(m_curNetId, m_viaRadius + m_curNetInfo->clearance, m_viaRadius / 2);
+	double margin = m_viaSites.margin();
+	auto isFree = [&](const Point& center) { return isViaClear(center, layer1, layer2, margin); };
+	return m_viaSites.nearestFree(pos, radius, layer1, layer2, isFree, site);
+}
+bool RouterMeshless::isViaClear(const Point& pos, int layer1, int layer2, double margin) {
+	// Same rules as checkViaPos, without pushing anything
+	double minDistance = m_viaRadius + m_curNetInfo->clearance + margin;
+	double viaBound0 = pos.x - minDistance;
+	double viaBound1 = pos.y - minDistance;
+	double viaBound2 = pos.x + minDistance;
+	double viaBound3 = pos.y + minDistance;
+	int maxLayer = min(layer2, m_gridManager->getMaxLayer());
+	vector<GridCell*>& cells = m_query.cells;
+	for (int layer = max(layer1, 0); layer <= maxLayer; ++layer) {
+		m_gridManager->getCellsNearPoint(pos, minDistance, layer, cells);
+		for (GridCell* cell : cells) {
+			for (const GridSegment& seg : cell->getPathLines()) {
+				if (!seg.line || !seg.shape || seg.netId == m_curNetId) continue;
+				double minDist = m_viaRadius + seg.halfWidth + max(m_curNetInfo->clearance, seg.shape->clearance) + margin;
+				if (Segment(seg.p1, seg.p2).distanceTo(pos) < minDist - MapMinValue)
+					return false;
+			}
+			for (const GridPad& gp : cell->getPinPads()) {
+				if (gp.box[0] > viaBound2 || gp.box[2] < viaBound0 || gp.box[1] > viaBound3 || gp.box[3] < viaBound1)
+					continue;
+				if (gp.netId == m_curNetId)
+					continue;
+				for (auto& edge : gp.pad->shapes[layer].edges) {
+					if (pos.distanceToEdge(edge.p1->pos, edge.p2->pos) < minDistance - MapMinValue)
+						return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+Box RouterMeshless::getPathBox(const PolyShape* shape) {
+	// Bounding box of the trace including its half width
+	const double inf = numeric_limits<double>::max();
+	Box box = { inf, inf, -inf, -inf };
+	for (const PathLine& e : shape->edges) {
+		for (const PathNode* node : { e.p1, e.p2 }) {
+			box[0] = min(box[0], node->pos.x - e.width / 2);
+			box[1] = min(box[1], node->pos.y - e.width / 2);
+			box[2] = max(box[2], node->pos.x + e.width / 2);
+			box[3] = max(box[3], node->pos.y + e.width / 2);
+		}
+	}
+	return box;
+}
 bool RouterMeshless::pushViaAndLine(PathNode* nodePre, int layer1, int layer2) {
 	if (!nodePre->next) return false;
 	bool isStart = !nodePre->prev;
@@ -1684,7 +1755,8 @@ bool RouterMeshless::pushViaAndLine(PathNode* nodePre, int layer1, int layer2) {
 		Point(-moveLength,moveLength),
 		Point(-moveLength,-moveLength),
 		Point(moveLength,-moveLength) };
-	for (const Point& offset : offsets) {
+	for (size_t i = 0; i < offsets.size(); ++i) {
+		const Point offset = offsets[i];
 		Point pVia = nodePre->pos + offset;
 		// Take the line segment behind or in front for pushing
 		Point p2 = nodePre->next->next->pos + offset;
@@ -1740,6 +1812,10 @@ bool RouterMeshless::pushViaAndLine(PathNode* nodePre, int layer1, int layer2) {
 				}
 			}
 		}
+		// The fixed offsets failed, last try at the nearest legal lattice site around the via
+		Point site;
+		if (i == 7 && getNearestViaSite(nodePre->pos, 2 * moveLength, layer1, layer2, site) && site != nodePre->pos)
+			offsets.push_back(site - nodePre->pos);
 	}
 	cout << "push via failed:" << nodePre->pos << endl;
 	return false;
@@ -1774,16 +1850,16 @@ void RouterMeshless::backTrackOnePath(PathTree* nodeEnd) {
 	PathTree* cur = nodeEnd;
 	//2. Backtrack and generate path doubly linked list
 	PolyShape* nullshape = nullptr;
-	PathNode* tail = new PathNode(cur->pos, nullshape, nodeEnd->netName, cur->layer);
+	PathNode* tail = new PathNode(cur->pos, nullshape, m_curNetName, cur->layer);
 	PathNode* n1 = tail;
 	while (cur->parent) {
 		if (cur->parent->layer != cur->layer && cur->parent->pos != cur->pos) {
 			// Not on the same layer and different coordinates, add a via
-			PathNode* nVia = new PathNode(cur->pos, nullshape, cur->netName, cur->parent->layer);
+			PathNode* nVia = new PathNode(cur->pos, nullshape, m_curNetName, cur->parent->layer);
 			n1->insertBefore(nVia);
 			n1 = nVia;
 		}
-		PathNode* n2 = new PathNode(cur->parent->pos, nullshape, nodeEnd->netName, cur->parent->layer);
+		PathNode* n2 = new PathNode(cur->parent->pos, nullshape, m_curNetName, cur->parent->layer);
 		n1->insertBefore(n2);
 		cur = cur->parent;
 		n1 = n2;
@@ -1922,10 +1998,7 @@ void RouterMeshless::checkNewStartNode() {		//2. Backtracking process, pin excha
 		if (newPad) {
 			cur->parent->children.erase(cur);
 			cur->parent = nullptr;
-			unordered_set<PathTree*>& children = m_node_start->children;
-			for (PathTree* childToDel : children)
-				childToDel->remove();
-			m_node_start->children.clear();
+			m_node_start->children.clear();	// The old branches stay in the arena until the trees are freed
 			// Update tree root node
 			changeStartOrEnd(true, newPad, cur->layer);
 			double stepG = cur->pos.distanceTo(newPad->pos);
@@ -2128,17 +2201,19 @@ void RouterMeshless::getPostPtsToPass(PathNode* start, PathNode* end, Point& ptT
 	double maxY = max(y1, y2) - MapMinValue;
 
 	// 1. Get which cells to search
-	vector<GridCell*> cells;
-	m_gridManager->getCellsInBox({ minX, minY, maxX, maxY }, cells);
+	m_query.begin(*m_gridManager);
+	vector<GridCell*>& cells = m_query.cells;
+	vector<PolyShape*>& obss = m_query.shapes;
+	m_gridManager->getCellsInBox({ minX, minY, maxX, maxY }, start->layer, cells);
 
 	// 2. Get same-layer obstacles in cells: polygon obstacles, line obstacles
-	unordered_set<PolyShape*> obss;
 	int startLayer = start->layer;
+	int netId = m_gridManager->getNetId(start->netName);
 
 	for (auto cell : cells) {
 		// 2.1 Candidate polygons, deduplicate, remove polygon obstacles (pads) where endpoints are located
-		for (PinPad* pad : cell->getPinPads()) {
-			if (!pad->shapes.contains(startLayer)) continue;    // Ignore shapes on different layers
+		for (const GridPad& gp : cell->getPinPads()) {
+			PinPad* pad = gp.pad;
 			PolyShape* obsShape = &pad->shapes[startLayer];
 
 			// Ignore polygons where endpoints are located
@@ -2146,17 +2221,16 @@ void RouterMeshless::getPostPtsToPass(PathNode* start, PathNode* end, Point& ptT
 			bool isEndPad = m_endPad->shapes.contains(end->layer) && obsShape == &m_endPad->shapes[end->layer];
 			if (isStartPad || isEndPad)
 				continue;
-			if (obss.find(obsShape) == obss.end()) {
-				obss.insert(obsShape);
-			}
+			if (m_query.visitPad(gp.padId))
+				obss.push_back(obsShape);
 		}
 
 		// 2.2 Candidate line obstacles, deduplicate (traces)
-		for (auto& [pathline, shape] : cell->getPathLines()) {
-			if (pathline->layer != startLayer) continue;        // Ignore lines on different layers
+		for (const GridSegment& seg : cell->getPathLines()) {
 			// Line obstacles under the same net
-			if (pathline->p1->netName == start->netName) continue;
-			obss.insert(shape);
+			if (seg.netId == netId) continue;
+			if (m_query.visitPath(seg.pathId))
+				obss.push_back(seg.shape);
 		}
 	}
 
@@ -2302,7 +2376,7 @@ void RouterMeshless::generateOnePath(PathNode* const head) {
 	//6. Set the planning point direction of the path
 	pathShape->setDirection();
 	//7. Add the path to the grid
-	m_gridManager->addShapeLines(pathShape);
+	addOnePathToGrid(pathShape);
 }
 
 // Push algorithm
@@ -2405,15 +2479,18 @@ Point RouterMeshless::lineIntersection(const Point& p1, const Point& p2, const P
 	double x4 = p4.x, y4 = p4.y;
 
 	double denom = (x1 - x2) * (y3 - y4) - (y1 - y2) * (x3 - x4);
-	if (fabs(denom) < 0.0001) {
+	bool parallel = m_fixedGrid.enabled()
+		? isParallelFixed(m_fixedGrid.toFixed(p1), m_fixedGrid.toFixed(p2), m_fixedGrid.toFixed(p3), m_fixedGrid.toFixed(p4))
+		: fabs(denom) < 0.0001;
+	if (parallel) {
 		// Parallel or coincident, return midpoint
-		return Point((x1 + x3) / 2, (y1 + y3) / 2);
+		return m_fixedGrid.snap(Point((x1 + x3) / 2, (y1 + y3) / 2));
 	}
 
 	double px = ((x1 * y2 - y1 * x2) * (x3 - x4) - (x1 - x2) * (x3 * y4 - y3 * x4)) / denom;
 	double py = ((x1 * y2 - y1 * x2) * (y3 - y4) - (y1 - y2) * (x3 * y4 - y3 * x4)) / denom;
 
-	return Point(px, py);
+	return m_fixedGrid.snap(Point(px, py));
 }
 bool RouterMeshless::isParallel(const Point& v1, const Point& v2) {
 	double v1LenSq = v1.x * v1.x + v1.y * v1.y;
@@ -2470,7 +2547,7 @@ void RouterMeshless::removeVias(PathNode* node1, PathNode* node2) {
 			auto it = m_vias.find(node1->pos);
 			if (it != m_vias.end()) {
 				PinPad& viaToRemove = it->second;
-				m_gridManager->removePinPad(&viaToRemove);
+				removePadFromGrid(&viaToRemove);
 				m_vias.erase(it);
 			}
 		}
@@ -2494,7 +2571,7 @@ void RouterMeshless::resetVias(PathNode* node1, PathNode* node2) {
 			for (int layer = layer1; layer <= layer2; layer++) {
 				newVia.addShape(layer, m_viaRadius, { 0,0 });
 			}
-			m_gridManager->addPinPad(&newVia);
+			addPadToGrid(&newVia);
 		}
 		node1 = node1->next;
 	}
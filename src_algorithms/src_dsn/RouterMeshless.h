@@ -1,6 +1,15 @@
 #pragma once
 #include "MST.h"
 #include "Grid.h"
+#include "QuadTree.h"
+#include "CollisionQuery.h"
+#include "ReachabilityCache.h"
+#include "CongestionField.h"
+#include "ViaSiteMap.h"
+#include "ExploredNodeTable.h"
+#include "ExpandedNodeGrid.h"
+#include "PathTreeHeap.h"
+#include "../src_basics/FixedPoint.h"
 #include "RoutingNode.h"
 #include <stack>
 #include <string>
@@ -39,12 +48,55 @@ public:
 	void pushLineDataUpdate(const PolyShape* shapeCopy, PolyShape* pathShape);
 	void addOnePathToGrid(PolyShape* shape) {
 		m_gridManager->addShapeLines(shape);
+		m_viaSites.obstacleChanged(getPathBox(shape), shape->clearance);
+		pathChangedForReach(shape);
 	}
 	void removeOnePathFromGrid(PolyShape* shape) {
 		m_gridManager->removeOnePath(shape);
+		m_viaSites.obstacleChanged(getPathBox(shape), shape->clearance);
+		pathChangedForReach(shape);
+	}
+	// Traces do not count as via congestion, pads do
+	void addPadToGrid(PinPad* pad) {
+		m_gridManager->addPinPad(pad);
+		m_congestion.padChanged(pad->box);
+		m_viaSites.obstacleChanged(pad->box, 0);
+		padChangedForReach(pad);
+	}
+	void removePadFromGrid(PinPad* pad) {
+		m_gridManager->removePinPad(pad);
+		m_congestion.padChanged(pad->box);
+		m_viaSites.obstacleChanged(pad->box, 0);
+		padChangedForReach(pad);
+	}
+	// Reachability answers only go stale around the changed edges, one box per trace segment
+	void pathChangedForReach(const PolyShape* shape) {
+		for (const PathLine& e : shape->edges) {
+			double hw = e.width / 2;
+			Box box = { min(e.p1->pos.x, e.p2->pos.x) - hw, min(e.p1->pos.y, e.p2->pos.y) - hw,
+				max(e.p1->pos.x, e.p2->pos.x) + hw, max(e.p1->pos.y, e.p2->pos.y) + hw };
+			m_reachCache.obstacleChanged(box, shape->clearance, e.layer);
+		}
+	}
+	void padChangedForReach(const PinPad* pad) {
+		for (const auto& [layer, shape] : pad->shapes)
+			m_reachCache.obstacleChanged(pad->box, shape.clearance, layer);
+	}
+	// Immutable view of the obstacle index for queries from other threads (nullptr for the quadtree)
+	// The search itself always queries the live index on the routing thread, tests/snapshot_stress.cpp checks the readers
+	shared_ptr<const ObstacleIndex> publishIndexSnapshot() {
+		return m_gridManager ? m_gridManager->publishSnapshot() : nullptr;
 	}
 	void setGrideSizeFactor(const double& alpha_g){ m_grideSizeFactor =  alpha_g;}
 	void setStandardCostFactor(const double& beta) { m_standardCostFactor = beta; };
+	void setObstacleIndexType(ObstacleIndexType type) { m_obstacleIndexType = type; };
+	// Snap generated points to integer dsn database units (1 / resolution), 0 keeps plain double coordinates
+	void setCoordinateResolution(double resolution) { m_fixedGrid = FixedGrid(resolution); };
+	void setGridRefineThreshold(int threshold) { m_gridRefineThreshold = threshold; };
+	// Pin pairs farther apart than factor * board diagonal are searched from both pads, 0 keeps every search one-sided
+	void setBidirectionalFactor(double factor) { m_bidirectionalFactor = factor; };
+	// Boards with at least this many routing layers queue the via children of a node as one lazy marker, 0 disables
+	void setLazyViaLayers(int layers) { m_lazyViaLayers = layers; };
 	void setRouterOption(const vector<bool>& boolOps) {
 		size_t opNum = boolOps.size();
 		if (opNum > 0) m_postOn = boolOps[0];
@@ -69,6 +121,8 @@ public:
 		m_beeakPt = pt;
 		m_breakIndex = breakID;
 	};
+	// Nearest point within radius of pos that is certainly a legal via position for the net being routed
+	bool getNearestViaSite(const Point& pos, double radius, int layer1, int layer2, Point& site);
 	vector<PathTree*>* getTreesHeadsOrdered() { return &m_pathTreesOrdered; };
 	unordered_map<PathNode*, PolyShape>* getPaths() { return &m_paths; };
 	unordered_set<Point, Point::Hash>* getPlanningPts() { return &m_planningPts; };
@@ -128,6 +182,7 @@ private:
 
 	// 2. Algorithm hyperparameters
 	double m_grideSizeFactor = 1;				//alpha_g
+	int m_gridRefineThreshold = 24;				// Grid cells holding more records are split into finer cells, 0 keeps the grid uniform
 	double m_standardCostFactor = 0.5;			//beta
 
 	double rectLengthFactor = 2.5;				// If aspect ratio is greater than this value, it is considered a long strip pad, and routing can only be led out along the strip direction
@@ -135,9 +190,18 @@ private:
 	double m_decayFactor = 0.75;				// Density cost decay coefficient
 	const double m_changeSTFactor = 0.15;		//beta_st
 	double m_pathViaMinLength = 4;				// Minimum length for layer change edges
+	int m_lazyViaLayers = 0;					// From this many routing layers on, via children are queued as one lazy marker per node, 0 = never
+	double m_bidirectionalFactor = 0;			// Pin pairs longer than this fraction of the board diagonal are searched from both pads
+	int m_meetTries = 4;						// Closest nodes of the other tree tested for line of sight per bidirectional expansion
 
 	// 3. Data continuously supplemented during algorithm execution
-	unique_ptr<GridManager> m_gridManager;				// Spatial index manager
+	ObstacleIndexType m_obstacleIndexType = ObstacleIndexType::Grid;
+	FixedGrid m_fixedGrid;								// Database unit grid, disabled by default
+	unique_ptr<ObstacleIndex> m_gridManager;			// Spatial index manager
+	mutable ObstacleQuery m_query;						// Scratch buffers of the leaf obstacle queries (getFirstShape etc.)
+	ReachabilityCache m_reachCache;						// getFirstShape answers, invalidated around index changes
+	mutable CongestionField m_congestion;				// getCongestionSum samples, kept up to date by addPadToGrid/removePadFromGrid
+	ViaSiteMap m_viaSites;								// Legal via sites of the current net, kept up to date like m_congestion
 	unordered_map<Point, PinPad, Point::Hash> m_vias;	// Vias
 	unordered_map<PathTree*, string> m_pathHeads;		// Netlist name corresponding to the path
 	unordered_set<Point, Point::Hash> m_planningPts;	// Only used for UI drawing
@@ -149,6 +213,7 @@ private:
 	double m_viaRadius = 1;
 	int m_serchTimesLimit = 1000;
 	string m_curNetName;				// Current routing net
+	int m_curNetId = -1;				// Grid net id of m_curNetName
 	NetInfo* m_curNetInfo;
 	PathTree* m_node_start;
 	PinPad* m_startPad;
@@ -157,6 +222,9 @@ private:
 	PinPad* m_endPad;
 	vector<shared_ptr<SteinerNode>> m_endNeibs;
 	vector<Point> m_endExits;
+	unordered_map<int, vector<Point>> m_usableEndExits;	// Layer -> end exits reachable from the end point (see getUsableEndExits)
+	uint64_t m_usableEndExitsVersion = 0;				// Index version and end point they were computed for
+	Point m_usableEndExitsFrom;
 	Point m_ptToEnd;
 	double m_ptToEndCost = 0;
 	unordered_set<int> m_routingLayers;	// Layers that can be routed
@@ -164,12 +232,37 @@ private:
 	unordered_set<int> m_endLayers;		// Layers where the end point is located
 	int m_postTimes = 0;				// Current post-processing recursion count
 
-	priority_queue<PathTree*, vector<PathTree*>, ComparePathTreePtr> m_leafNodesList;	// Leaf nodes to be expanded
-	unordered_map<Point, unordered_map<int, PathTree*>, Point::Hash> m_exploredNodes;	// Explored planning points
+	PathTreeHeap m_leafNodesList;		// Leaf nodes to be expanded
+	ExploredNodeTable m_exploredNodes;		// Explored planning points
 	queue<PolyShape*> m_candidateObss;
 	unordered_set<PolyShape*> m_queryObssPassed;
 	unordered_set<Point, Point::Hash> m_querySTChanged;		// Start/end points that have been modified (passed)
 
+	// Search state of one direction, the bidirectional search parks the idle direction here (see swapSearchSide)
+	struct SearchSide {
+		PathTree* nodeStart = nullptr;
+		PathTree* nodeEnd = nullptr;
+		PinPad* startPad = nullptr;
+		PinPad* endPad = nullptr;
+		vector<shared_ptr<SteinerNode>> startNeibs;
+		vector<shared_ptr<SteinerNode>> endNeibs;
+		unordered_set<int> startLayers;
+		unordered_set<int> endLayers;
+		vector<Point> endExits;
+		unordered_map<int, vector<Point>> usableEndExits;
+		uint64_t usableEndExitsVersion = 0;
+		Point usableEndExitsFrom;
+		Point ptToEnd;
+		double ptToEndCost = 0;
+		PathTreeHeap leafNodesList;
+		ExploredNodeTable exploredNodes;
+		ExpandedNodeGrid expandedNodes;
+	};
+	SearchSide m_otherSide;
+	bool m_searchingBackward = false;		// The members hold the search from the end pad towards the start pad
+	ExpandedNodeGrid m_expandedNodes;		// Nodes expanded by the current direction, only kept by the bidirectional search
+	vector<pair<double, PathTree*>> m_meetCandidates;	// Scratch of findMeetingNode
+
 	// 5. Statistical data (reset or modified during algorithm execution)
 	int m_totalPins = 0;
 	int m_curPathIndex = 0;		// Current path index being searched
@@ -183,6 +276,7 @@ private:
 	unordered_map<string, vector<PathTree*>> m_treesHeads;	// net_name->all paths, tree structure
 	vector<PathTree*> m_pathTreesOrdered;					// Search tree root nodes (ordered)
 	unordered_map<PathNode*, PolyShape> m_paths;			// Linked list node corresponding to the path start point, the path corresponding to this node (line segment collection)
+	vector<unique_ptr<PathTreeArena>> m_treeArenas;			// Search tree nodes, one arena per pin-pair search
 
 private:
 	function<bool(const pair<PinPad*, PinPad*>&, const pair<PinPad*, PinPad*>&)> m_priorityRule;
@@ -238,7 +332,7 @@ private:
 	void setStartAndEnd();
 	void setStartPad(int layer_s);
 	void setEndPad(int layer_e);
-	void setPadOuPts(PathTree* nodeToSet, PathTree* nodeToIgnore, double minClear, const vector<double>& box, int startIdx, int step, vector<Point>& outDirectionsPts);
+	void setPadOuPts(PathTree* nodeToSet, PathTree* nodeToIgnore, double minClear, const Box& box, int startIdx, int step, vector<Point>& outDirectionsPts);
 	int getPinPadOutDirection(PathTree* const nodeSE, PinPad*& padptr);
 	bool changeStartOrEnd(bool isStart, PinPad* pad, int layer);
 	bool updateSteinerTopology(const shared_ptr<SteinerNode>& steinerToChange, const shared_ptr<SteinerNode>& steinerToHold, const shared_ptr<SteinerNode>& newST);
@@ -256,12 +350,18 @@ private:
 
 	//PPDT routing algorithm
 	bool runPPDT();
+	bool searchStep(PathTree*& minNode);
+	bool searchBidirectional();
+	void setBackwardSearch();
+	void swapSearchSide();
+	PathTree* findMeetingNode(PathTree* node, const ExpandedNodeGrid& others);
+	void joinBackwardPath(PathTree* node, PathTree* backNode);
 	bool route_GND();
 	bool isTreeGNDConnected(PathTree* node);
+	PathTree* popLeafNode();
 	PathTree* nodeSelection();
+	const vector<Point>& getUsableEndExits(int layer);
 	void obssExploration(const PathTree* start);
-	void getCandidateObss(const unordered_set<PolyShape*>& obss, const Line& line);
-	void getValidObssInCells(const vector<GridCell*>& cells, const Line& line, int layer, unordered_set<PolyShape*>& obss);
 	bool nodeExpansion(PathTree* start);
 	void nodeExpansionWithObsShape(PathTree* start, PolyShape* obsShape);
 	bool checkConnectToEnd(PathTree* start);
@@ -270,9 +370,16 @@ private:
 	void setAllPtsAsChildren(PathTree* start, PolyShape* currentPad);
 	bool connectToPos(PathTree* start, const Point& pos, PathNode* vertexNode, bool inserVia);
 	PathTree* posGetNode(const Point& pos, int layer);
+	PathTree* newTreeNode(const Point& pos, int layer, PathNode* vertexNode) {
+		return m_treeArenas.back()->create(pos, layer, m_curNetId, vertexNode);
+	}
 	bool getGHVia(PathTree* start, const Point& pos, int layer, double& G, double& H);
+	double estimateToEnd(const Point& pos, int layer);
 	void updateExistingNode(PathTree* start, PathTree* oldNode, const double& G, const double& H);
 	PathTree* addOneChild(PathTree* start, const Point& pos, int layer, PathNode* vertexNode, bool allowVia);
+	void addViaChildren(PathTree* node);
+	void pushViaMarker(PathTree* node);
+	double viaMarkerBound(PathTree* node);
 	int getCongestionSum(const Point& pos, double r, int layer1, int layer2) const;
 	void nodeOptimaze(PathTree* node);
 
@@ -280,7 +387,10 @@ private:
 	bool isReachable2(const Point& p1, const Point& p2, int layer, PinPad* ignorePad2, PolyShape** firstObsPtr = nullptr);
 
 	PolyShape* getFirstShape(const Point& p1, const Point& p2, int layer, PinPad* ignorePad, PinPad* ignorePad2 = nullptr);
+	// getFirstShape for every segment origin->targets[i], uncached segments are answered by one fan query
+	void getFirstShapes(const Point& origin, const vector<Point>& targets, int layer, PinPad* ignorePad, PinPad* ignorePad2, vector<PolyShape*>& firstShapes);
 	bool isReachable(const Point& p1, const Point& p2, int layer, PinPad* ignorePad1, PinPad* ignorePad2, PolyShape** firstObsPtr = nullptr);
+	bool isFreeOrPad(PolyShape* firstObs, PinPad* pad, int layer);
 
 
 	bool checkPushLine(PathNode* M, PathNode* N, const Point pushVec);
@@ -289,6 +399,11 @@ private:
 	void insertVias(PathNode* head, PathNode* tail);
 	void insertOneVia(PathNode* viaPre);
 	bool checkViaPos(const Point& pos, int layer1, int layer2);
+	// Lattice lookup: true if pos is certainly a legal via position (nothing to push or avoid)
+	bool isViaSiteFree(const Point& pos, int layer1, int layer2);
+	// No trace or pad of another net closer than the via clearance plus margin
+	bool isViaClear(const Point& pos, int layer1, int layer2, double margin);
+	static Box getPathBox(const PolyShape* shape);
 	bool pushViaAndLine(PathNode* nodePre, int layer1, int layer2);
 	bool moveSEVia(PathNode* viaPre, int layer1, int layer2, bool isStart);
 	void backTrackOnePath(PathTree* nodeEnd);
@@ -334,10 +449,12 @@ private:
 	void netNameChange(const string& netName) {
 		m_netNameBackup = m_curNetName;
 		m_curNetName = netName;
+		m_curNetId = m_gridManager->getNetId(m_curNetName);
 		m_curNetInfo = &m_netsInfos->at(m_curNetName);
 	}
 	void netNameReset() {
 		m_curNetName = m_netNameBackup;
+		m_curNetId = m_gridManager->getNetId(m_curNetName);
 		m_curNetInfo = &m_netsInfos->at(m_curNetName);
 	}
 
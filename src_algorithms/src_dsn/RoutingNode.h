@@ -2,8 +2,11 @@
 #include <queue>
 #include <unordered_set>
 #include <optional>
+#include <memory>
+#include <new>
 
 #include "../src_basics/dataStructAlg.h"
+#include "../src_basics/Geometry2D.h"
 
 using namespace std;
 // Forward declaration
@@ -254,7 +257,7 @@ struct PinPad {
 	string netName;
 	unordered_map<int, PolyShape> shapes;	// Layer, shape
 	double r = 0;	// Radius, only for circles
-	vector<double> box = { 0,0,0,0 };
+	Box box = { 0,0,0,0 };
 	PinPad() : r(0) {};
 	PinPad(const Point& pos, const string& shapeName, const string& netName = "", const double& clear = 0.0)
 		: pos(pos), shapeName(shapeName), netName(netName), clearance(clear) {
@@ -383,21 +386,47 @@ struct PinPad {
 private:
 	double clearance = 0;		// Polygon spacing
 };
+// Children of a search node, intrusive doubly linked sibling list (the links live in the child nodes)
+struct PathTreeChildren {
+	struct iterator {
+		PathTree* node;
+		PathTree* operator*() const { return node; }
+		iterator& operator++();
+		bool operator!=(const iterator& other) const { return node != other.node; }
+		bool operator==(const iterator& other) const { return node == other.node; }
+	};
+	PathTree* first = nullptr;
+
+	iterator begin() const { return { first }; }
+	iterator end() const { return { nullptr }; }
+	bool empty() const { return first == nullptr; }
+	void insert(PathTree* child);
+	void erase(PathTree* child);
+	void clear();
+};
+// Search tree node, allocated from the PathTreeArena of its pin-pair search
 struct PathTree {
-	PathTree() : layer(0), netName("") {};
-	PathTree(const Point& position, const int& layer, string netName, PathNode* pNode)
-		: pos(position), layer(layer), netName(netName), pNode(pNode) {
+	PathTree() : layer(0) {};
+	PathTree(const Point& position, const int& layer, int netId, PathNode* pNode)
+		: pos(position), layer(layer), pNode(pNode), netId(netId) {
 	};
+	PathTree(const PathTree&) = delete;
+	PathTree& operator=(const PathTree&) = delete;
 	Point pos;
 	int layer;
 	double g = 0;  // Actual cost from start to current node
 	double h = 0;  // Estimated cost from current node to end
 	double f = 0;  // Total cost f = g + h
 	PathNode* pNode = nullptr;	// Only for planning points, through pNode you can access which shape this planning point belongs to
-	string netName;
+	int netId = -1;				// Obstacle index net id of the searched net
 
 	PathTree* parent = nullptr;
-	unordered_set<PathTree*> children;
+	PathTreeChildren children;
+	PathTree* prevSibling = nullptr;
+	PathTree* nextSibling = nullptr;
+	int heapIndex = -1;			// Slot in the open list (PathTreeHeap), -1 if not queued
+	PathTree* viaSource = nullptr;	// Set on lazy via markers: the node whose via children are created when the marker is popped
+	PathTree* viaMarker = nullptr;	// Lazy via marker of this node while it waits in the open list
 	void addChild(PathTree* child, const double& stepG, const double& estimateH) {
 		// Delete original relationships (if any) and set connections
 		if (child->parent)
@@ -429,20 +458,18 @@ struct PathTree {
 		h = pos.distanceTo(node_end->pos);
 		updateTreefgh(20);
 	}
+	// Detach child and its subtree, the nodes are released with their arena
 	void removeChild(PathTree* child) {
 		if (!child) return;
-		// Recursively delete child nodes
 		children.erase(child);
 		child->parent = nullptr;
-		deleteSubtree(child);
 	}
+	// Detach this node and its subtree from the tree
 	void remove() {
-		// Delete current node and all its child nodes
 		if (parent)
 			parent->removeChild(this);
-		else
-			deleteSubtree(this);
 	}
+	// Take over the data of node, the tree links of this node are dropped (its children are detached)
 	void copyIn(const PathTree& node) {
 		pos = node.pos;
 		layer = node.layer;
@@ -450,9 +477,14 @@ struct PathTree {
 		h = node.h;
 		f = node.f;
 		pNode = node.pNode;
-		netName = node.netName;
-		parent = node.parent;
-		children = node.children;
+		netId = node.netId;
+		children.clear();
+		if (parent != node.parent) {
+			remove();
+			if (node.parent)
+				node.parent->children.insert(this);
+			parent = node.parent;
+		}
 	}
 	void updateTreefgh(double viaCost) {
 		queue<PathTree*> nodes;
@@ -478,16 +510,69 @@ struct PathTree {
 	size_t hash() const {
 		return std::hash<const PathTree*>{}(this);
 	}
-private:
-	void deleteSubtree(PathTree* node) {	// Recursive function
-		if (!node) return;
-		for (auto it = node->children.begin(); it != node->children.end(); ) {
-			PathTree* child = *it;
-			it = node->children.erase(it);  // First remove from the collection
-			deleteSubtree(child);           // Recursively delete
+};
+inline PathTreeChildren::iterator& PathTreeChildren::iterator::operator++() {
+	node = node->nextSibling;
+	return *this;
+}
+inline void PathTreeChildren::insert(PathTree* child) {
+	child->prevSibling = nullptr;
+	child->nextSibling = first;
+	if (first)
+		first->prevSibling = child;
+	first = child;
+}
+inline void PathTreeChildren::erase(PathTree* child) {
+	if (child->prevSibling)
+		child->prevSibling->nextSibling = child->nextSibling;
+	else if (first == child)
+		first = child->nextSibling;
+	else
+		return;		// Not in this list
+	if (child->nextSibling)
+		child->nextSibling->prevSibling = child->prevSibling;
+	child->prevSibling = child->nextSibling = nullptr;
+}
+inline void PathTreeChildren::clear() {
+	PathTree* child = first;
+	while (child) {
+		PathTree* next = child->nextSibling;
+		child->prevSibling = child->nextSibling = nullptr;
+		child = next;
+	}
+	first = nullptr;
+}
+// Owns the search nodes of one pin-pair search, they are all released together with the arena
+// Nodes live in fixed-size blocks so their addresses never change
+class PathTreeArena {
+public:
+	PathTreeArena() {}
+	PathTreeArena(const PathTreeArena&) = delete;
+	PathTreeArena& operator=(const PathTreeArena&) = delete;
+	~PathTreeArena() {
+		for (size_t b = 0; b < m_blocks.size(); ++b) {
+			size_t count = b + 1 == m_blocks.size() ? m_used : BlockSize;
+			for (size_t i = 0; i < count; ++i)
+				m_blocks[b].get()[i].~PathTree();
 		}
-		delete node;
 	}
+
+	PathTree* create(const Point& position, int layer, int netId, PathNode* pNode) {
+		if (m_blocks.empty() || m_used == BlockSize) {
+			m_blocks.emplace_back(static_cast<PathTree*>(::operator new(sizeof(PathTree) * BlockSize)));
+			m_used = 0;
+		}
+		return new (m_blocks.back().get() + m_used++) PathTree(position, layer, netId, pNode);
+	}
+	size_t size() const { return m_blocks.empty() ? 0 : (m_blocks.size() - 1) * BlockSize + m_used; }
+
+private:
+	static constexpr size_t BlockSize = 512;
+	struct BlockDeleter {
+		void operator()(PathTree* block) const { ::operator delete(block); }
+	};
+	std::vector<std::unique_ptr<PathTree, BlockDeleter>> m_blocks;
+	size_t m_used = 0;
 };
 struct ComparePathTreePtr {
 	bool operator()(const PathTree* a, const PathTree* b) const {
@@ -0,0 +1,172 @@
+#include "SegmentBatch.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define PPDT_AVX2_TARGET __attribute__((target("avx2,fma")))
+#define PPDT_HAS_AVX2_PATH 1
+#elif defined(__AVX2__)
+#define PPDT_AVX2_TARGET
+#define PPDT_HAS_AVX2_PATH 1
+#endif
+#endif
+
+namespace {
+	// Squared distance from point p to segment s + t * v, t in [0, 1]
+	inline double pointSegDist2(double px, double py, double sx, double sy, double vx, double vy) {
+		double wx = px - sx;
+		double wy = py - sy;
+		double c1 = wx * vx + wy * vy;
+		double c2 = vx * vx + vy * vy;
+		double t = c1 <= 0 ? 0 : (c2 <= c1 ? 1 : c1 / c2);
+		double dx = wx - vx * t;
+		double dy = wy - vy * t;
+		return dx * dx + dy * dy;
+	}
+
+	inline bool oppositeSides(double a, double b) { return (a > 0 && b < 0) || (a < 0 && b > 0); }
+	// Endpoint p with cross product d is on segment s1s2: collinear and inside its box grown by MapMinValue
+	inline bool touches(double d, double px, double py, double sx1, double sy1, double sx2, double sy2) {
+		return std::abs(d) < MapMinValue &&
+			px >= std::min(sx1, sx2) - MapMinValue && px <= std::max(sx1, sx2) + MapMinValue &&
+			py >= std::min(sy1, sy2) - MapMinValue && py <= std::max(sy1, sy2) + MapMinValue;
+	}
+
+	int findBlockingEdgesFrom(const Vec2& q1, const Vec2& q2, SegmentBatch& batch, size_t begin) {
+		const double ux = q2.x - q1.x;
+		const double uy = q2.y - q1.y;
+		const double minValue2 = MapMinValue * MapMinValue;
+		int blocked = 0;
+		for (size_t i = begin; i < batch.size(); ++i) {
+			double ax = batch.x1[i], ay = batch.y1[i];
+			double bx = batch.x2[i], by = batch.y2[i];
+			double vx = bx - ax, vy = by - ay;
+			// Proper crossing or touching endpoint, same cross products as Line::intersects
+			double d1 = vx * (q1.y - ay) - vy * (q1.x - ax);
+			double d2 = vx * (q2.y - ay) - vy * (q2.x - ax);
+			double d3 = ux * (ay - q1.y) - uy * (ax - q1.x);
+			double d4 = ux * (by - q1.y) - uy * (bx - q1.x);
+			bool intersects = (oppositeSides(d1, d2) && oppositeSides(d3, d4)) ||
+				touches(d1, q1.x, q1.y, ax, ay, bx, by) || touches(d2, q2.x, q2.y, ax, ay, bx, by) ||
+				touches(d3, ax, ay, q1.x, q1.y, q2.x, q2.y) || touches(d4, bx, by, q1.x, q1.y, q2.x, q2.y);
+			double dist2 = 0;
+			if (!intersects) {
+				dist2 = std::min(std::min(pointSegDist2(q1.x, q1.y, ax, ay, vx, vy), pointSegDist2(q2.x, q2.y, ax, ay, vx, vy)),
+					std::min(pointSegDist2(ax, ay, q1.x, q1.y, ux, uy), pointSegDist2(bx, by, q1.x, q1.y, ux, uy)));
+				if (dist2 < minValue2)
+					dist2 = 0;
+			}
+			double minDist = batch.minDist[i];
+			batch.violation[i] = minDist > 0 ? minDist * minDist - dist2 : -1;
+			if (batch.violation[i] > 0)
+				++blocked;
+		}
+		return blocked;
+	}
+
+#ifdef PPDT_HAS_AVX2_PATH
+	PPDT_AVX2_TARGET inline __m256d pointSegDist2Avx(__m256d px, __m256d py, __m256d sx, __m256d sy, __m256d vx, __m256d vy) {
+		const __m256d zero = _mm256_setzero_pd();
+		const __m256d one = _mm256_set1_pd(1.0);
+		__m256d wx = _mm256_sub_pd(px, sx);
+		__m256d wy = _mm256_sub_pd(py, sy);
+		__m256d c1 = _mm256_fmadd_pd(wx, vx, _mm256_mul_pd(wy, vy));
+		__m256d c2 = _mm256_fmadd_pd(vx, vx, _mm256_mul_pd(vy, vy));
+		// t = clamp(c1 / c2, 0, 1), zero-length segments give t = 0
+		__m256d t = _mm256_div_pd(c1, _mm256_max_pd(c2, _mm256_set1_pd(1e-300)));
+		t = _mm256_min_pd(_mm256_max_pd(t, zero), one);
+		__m256d dx = _mm256_fnmadd_pd(vx, t, wx);
+		__m256d dy = _mm256_fnmadd_pd(vy, t, wy);
+		return _mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy));
+	}
+
+	PPDT_AVX2_TARGET inline __m256d oppositeSidesAvx(__m256d a, __m256d b) {
+		const __m256d zero = _mm256_setzero_pd();
+		return _mm256_or_pd(_mm256_and_pd(_mm256_cmp_pd(a, zero, _CMP_GT_OQ), _mm256_cmp_pd(b, zero, _CMP_LT_OQ)),
+			_mm256_and_pd(_mm256_cmp_pd(a, zero, _CMP_LT_OQ), _mm256_cmp_pd(b, zero, _CMP_GT_OQ)));
+	}
+	// touches() for four endpoints, lo/hi is the segment box grown by MapMinValue
+	PPDT_AVX2_TARGET inline __m256d touchesAvx(__m256d d, __m256d px, __m256d py, __m256d loX, __m256d loY, __m256d hiX, __m256d hiY) {
+		const __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFll));
+		__m256d on = _mm256_cmp_pd(_mm256_and_pd(d, absMask), _mm256_set1_pd(MapMinValue), _CMP_LT_OQ);
+		on = _mm256_and_pd(on, _mm256_and_pd(_mm256_cmp_pd(px, loX, _CMP_GE_OQ), _mm256_cmp_pd(px, hiX, _CMP_LE_OQ)));
+		return _mm256_and_pd(on, _mm256_and_pd(_mm256_cmp_pd(py, loY, _CMP_GE_OQ), _mm256_cmp_pd(py, hiY, _CMP_LE_OQ)));
+	}
+
+	PPDT_AVX2_TARGET int findBlockingEdgesAvx2(const Vec2& q1, const Vec2& q2, SegmentBatch& batch) {
+		const size_t n = batch.size();
+		const __m256d q1x = _mm256_set1_pd(q1.x), q1y = _mm256_set1_pd(q1.y);
+		const __m256d q2x = _mm256_set1_pd(q2.x), q2y = _mm256_set1_pd(q2.y);
+		const __m256d ux = _mm256_sub_pd(q2x, q1x), uy = _mm256_sub_pd(q2y, q1y);
+		const __m256d zero = _mm256_setzero_pd();
+		const __m256d minValue2 = _mm256_set1_pd(MapMinValue * MapMinValue);
+		const __m256d minusOne = _mm256_set1_pd(-1.0);
+		const __m256d tolerance = _mm256_set1_pd(MapMinValue);
+		const __m256d qLoX = _mm256_sub_pd(_mm256_min_pd(q1x, q2x), tolerance), qLoY = _mm256_sub_pd(_mm256_min_pd(q1y, q2y), tolerance);
+		const __m256d qHiX = _mm256_add_pd(_mm256_max_pd(q1x, q2x), tolerance), qHiY = _mm256_add_pd(_mm256_max_pd(q1y, q2y), tolerance);
+		int blocked = 0;
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			__m256d ax = _mm256_loadu_pd(&batch.x1[i]), ay = _mm256_loadu_pd(&batch.y1[i]);
+			__m256d bx = _mm256_loadu_pd(&batch.x2[i]), by = _mm256_loadu_pd(&batch.y2[i]);
+			__m256d vx = _mm256_sub_pd(bx, ax), vy = _mm256_sub_pd(by, ay);
+			// Proper crossing or touching endpoint, no fused multiply-add so the signs match the scalar code
+			__m256d d1 = _mm256_sub_pd(_mm256_mul_pd(vx, _mm256_sub_pd(q1y, ay)), _mm256_mul_pd(vy, _mm256_sub_pd(q1x, ax)));
+			__m256d d2 = _mm256_sub_pd(_mm256_mul_pd(vx, _mm256_sub_pd(q2y, ay)), _mm256_mul_pd(vy, _mm256_sub_pd(q2x, ax)));
+			__m256d d3 = _mm256_sub_pd(_mm256_mul_pd(ux, _mm256_sub_pd(ay, q1y)), _mm256_mul_pd(uy, _mm256_sub_pd(ax, q1x)));
+			__m256d d4 = _mm256_sub_pd(_mm256_mul_pd(ux, _mm256_sub_pd(by, q1y)), _mm256_mul_pd(uy, _mm256_sub_pd(bx, q1x)));
+			__m256d eLoX = _mm256_sub_pd(_mm256_min_pd(ax, bx), tolerance), eLoY = _mm256_sub_pd(_mm256_min_pd(ay, by), tolerance);
+			__m256d eHiX = _mm256_add_pd(_mm256_max_pd(ax, bx), tolerance), eHiY = _mm256_add_pd(_mm256_max_pd(ay, by), tolerance);
+			__m256d intersects = _mm256_and_pd(oppositeSidesAvx(d1, d2), oppositeSidesAvx(d3, d4));
+			intersects = _mm256_or_pd(intersects, _mm256_or_pd(touchesAvx(d1, q1x, q1y, eLoX, eLoY, eHiX, eHiY),
+				touchesAvx(d2, q2x, q2y, eLoX, eLoY, eHiX, eHiY)));
+			intersects = _mm256_or_pd(intersects, _mm256_or_pd(touchesAvx(d3, ax, ay, qLoX, qLoY, qHiX, qHiY),
+				touchesAvx(d4, bx, by, qLoX, qLoY, qHiX, qHiY)));
+			__m256d dist2 = _mm256_min_pd(
+				_mm256_min_pd(pointSegDist2Avx(q1x, q1y, ax, ay, vx, vy), pointSegDist2Avx(q2x, q2y, ax, ay, vx, vy)),
+				_mm256_min_pd(pointSegDist2Avx(ax, ay, q1x, q1y, ux, uy), pointSegDist2Avx(bx, by, q1x, q1y, ux, uy)));
+			__m256d snapToZero = _mm256_or_pd(intersects, _mm256_cmp_pd(dist2, minValue2, _CMP_LT_OQ));
+			dist2 = _mm256_blendv_pd(dist2, zero, snapToZero);
+			__m256d minDist = _mm256_loadu_pd(&batch.minDist[i]);
+			__m256d violation = _mm256_fmsub_pd(minDist, minDist, dist2);
+			violation = _mm256_blendv_pd(minusOne, violation, _mm256_cmp_pd(minDist, zero, _CMP_GT_OQ));
+			_mm256_storeu_pd(&batch.violation[i], violation);
+			int mask = _mm256_movemask_pd(_mm256_cmp_pd(violation, zero, _CMP_GT_OQ));
+			blocked += (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+		}
+		return blocked + findBlockingEdgesFrom(q1, q2, batch, i);
+	}
+
+	bool cpuHasAvx2() {
+#if defined(__GNUC__) || defined(__clang__)
+		static const bool hasAvx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		return hasAvx2;
+#else
+		return true;	// Built with /arch:AVX2
+#endif
+	}
+#endif
+}
+
+int findBlockingEdges(const Vec2& q1, const Vec2& q2, SegmentBatch& batch) {
+	batch.violation.resize(batch.size());
+#ifdef PPDT_HAS_AVX2_PATH
+	if (cpuHasAvx2())
+		return findBlockingEdgesAvx2(q1, q2, batch);
+#endif
+	return findBlockingEdgesFrom(q1, q2, batch, 0);
+}
+int findBlockingEdgesScalar(const Vec2& q1, const Vec2& q2, SegmentBatch& batch) {
+	batch.violation.resize(batch.size());
+	return findBlockingEdgesFrom(q1, q2, batch, 0);
+}
+bool findBlockingEdgesUsesAvx2() {
+#ifdef PPDT_HAS_AVX2_PATH
+	return cpuHasAvx2();
+#else
+	return false;
+#endif
+}
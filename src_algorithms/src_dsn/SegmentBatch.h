@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+#include "../src_basics/Geometry2D.h"
+
+// Structure-of-arrays batch of obstacle edges tested against one query segment
+struct SegmentBatch {
+	std::vector<double> x1, y1, x2, y2;
+	std::vector<double> minDist;		// Edge blocks if it is closer than this (already reduced by the tolerance)
+	std::vector<double> violation;		// Output: minDist^2 - squared distance, > 0 if the edge blocks
+
+	void clear() {
+		x1.clear();
+		y1.clear();
+		x2.clear();
+		y2.clear();
+		minDist.clear();
+	}
+	void add(const Vec2& p1, const Vec2& p2, double dist) {
+		x1.push_back(p1.x);
+		y1.push_back(p1.y);
+		x2.push_back(p2.x);
+		y2.push_back(p2.y);
+		minDist.push_back(dist);
+	}
+	size_t size() const { return x1.size(); }
+};
+
+// Fill batch.violation for segment q1q2 and return the number of blocking edges
+// Squared distances only, segments that intersect (crossing, or an endpoint collinear with and on the other segment,
+// both within MapMinValue) count as distance 0 and distances below MapMinValue are snapped to 0 (same rules as
+// Line::distanceToLine); uses AVX2 when the CPU has it, scalar code otherwise
+int findBlockingEdges(const Vec2& q1, const Vec2& q2, SegmentBatch& batch);
+// The scalar code alone, and whether findBlockingEdges takes the AVX2 path (tests/segment_batch_check.cpp)
+int findBlockingEdgesScalar(const Vec2& q1, const Vec2& q2, SegmentBatch& batch);
+bool findBlockingEdgesUsesAvx2();
@@ -0,0 +1,134 @@
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <bitset>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+
+#include "../src_basics/Geometry2D.h"
+
+// Legal via sites of the net being routed, on a square lattice per layer pair
+// A lattice cell is marked free only if its center keeps reach + half the cell diagonal from every obstacle, so every point
+// inside it is a legal via position; cells are evaluated on first use and dropped again when an obstacle nearby is added
+class ViaSiteMap {
+public:
+	enum class Site : uint8_t { Unknown, Free, Blocked };
+
+	// Sites only hold for one net and one via reach (via radius plus clearance), anything else starts over
+	void sync(int netId, double reach, double pitch) {
+		if (netId == m_netId && reach == m_reach && pitch == m_pitch)
+			return;
+		clear();
+		m_netId = netId;
+		m_reach = reach;
+		m_pitch = pitch > 0 ? pitch : 1;
+	}
+	void clear() {
+		m_tiles.clear();
+		m_layerPairs.clear();
+	}
+
+	// Distance the center of a cell must keep beyond reach
+	double margin() const { return m_pitch * std::sqrt(0.5); }
+	Point cellCenter(const Point& pos) const {
+		return Point((cellCoord(pos.x) + 0.5) * m_pitch, (cellCoord(pos.y) + 0.5) * m_pitch);
+	}
+
+	Site find(const Point& pos, int layer1, int layer2) const {
+		int64_t cx = cellCoord(pos.x), cy = cellCoord(pos.y);
+		auto it = m_tiles.find(TileKey{ tileCoord(cx), tileCoord(cy), layer1, layer2 });
+		if (it == m_tiles.end())
+			return Site::Unknown;
+		int bit = bitIndex(cx, cy);
+		if (!it->second.known[bit])
+			return Site::Unknown;
+		return it->second.free[bit] ? Site::Free : Site::Blocked;
+	}
+	void store(const Point& pos, int layer1, int layer2, bool free) {
+		int64_t cx = cellCoord(pos.x), cy = cellCoord(pos.y);
+		Tile& tile = m_tiles[TileKey{ tileCoord(cx), tileCoord(cy), layer1, layer2 }];
+		int bit = bitIndex(cx, cy);
+		tile.known[bit] = true;
+		tile.free[bit] = free;
+		if (std::find(m_layerPairs.begin(), m_layerPairs.end(), std::make_pair(layer1, layer2)) == m_layerPairs.end())
+			m_layerPairs.emplace_back(layer1, layer2);
+	}
+
+	// An obstacle with bounding box box (including its own half width) and clearance entered or left the index
+	void obstacleChanged(const Box& box, double clearance) {
+		if (m_tiles.empty()) return;
+		double inflate = m_reach + clearance + margin();
+		int64_t tx0 = tileCoord(cellCoord(box[0] - inflate)), ty0 = tileCoord(cellCoord(box[1] - inflate));
+		int64_t tx1 = tileCoord(cellCoord(box[2] + inflate)), ty1 = tileCoord(cellCoord(box[3] + inflate));
+		for (const auto& [layer1, layer2] : m_layerPairs) {
+			for (int64_t tx = tx0; tx <= tx1; ++tx) {
+				for (int64_t ty = ty0; ty <= ty1; ++ty)
+					m_tiles.erase(TileKey{ tx, ty, layer1, layer2 });
+			}
+		}
+	}
+
+	// Nearest cell center within radius of p whose cell is free, unknown cells are evaluated with isFree(center)
+	template <typename IsFree>
+	bool nearestFree(const Point& p, double radius, int layer1, int layer2, IsFree isFree, Point& site) {
+		int64_t cx0 = cellCoord(p.x - radius), cy0 = cellCoord(p.y - radius);
+		int64_t cx1 = cellCoord(p.x + radius), cy1 = cellCoord(p.y + radius);
+		std::vector<std::pair<double, Point>> candidates;
+		for (int64_t cx = cx0; cx <= cx1; ++cx) {
+			for (int64_t cy = cy0; cy <= cy1; ++cy) {
+				Point center((cx + 0.5) * m_pitch, (cy + 0.5) * m_pitch);
+				double dist = p.distanceTo(center);
+				if (dist <= radius)
+					candidates.emplace_back(dist, center);
+			}
+		}
+		std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+		for (const auto& [dist, center] : candidates) {
+			Site s = find(center, layer1, layer2);
+			if (s == Site::Unknown) {
+				bool free = isFree(center);
+				store(center, layer1, layer2, free);
+				s = free ? Site::Free : Site::Blocked;
+			}
+			if (s == Site::Free) {
+				site = center;
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	static constexpr int TileBits = 4;		// 16 x 16 cells per tile
+	static constexpr int TileCells = 1 << TileBits;
+
+	struct TileKey {
+		int64_t tx, ty;
+		int layer1, layer2;
+		bool operator==(const TileKey& k) const { return tx == k.tx && ty == k.ty && layer1 == k.layer1 && layer2 == k.layer2; }
+	};
+	struct TileKeyHash {
+		size_t operator()(const TileKey& k) const {
+			uint64_t h = (uint64_t)k.tx * 0x9E3779B97F4A7C15ull;
+			h ^= (uint64_t)k.ty * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+			h ^= (((uint64_t)(uint32_t)k.layer1 << 32) | (uint32_t)k.layer2) * 0x165667B19E3779F9ull;
+			return (size_t)(h ^ (h >> 31));
+		}
+	};
+	struct Tile {
+		std::bitset<TileCells * TileCells> known;
+		std::bitset<TileCells * TileCells> free;
+	};
+
+	int64_t cellCoord(double v) const { return (int64_t)std::floor(v / m_pitch); }
+	static int64_t tileCoord(int64_t c) { return c >> TileBits; }		// Arithmetic shift, floors negative cells too
+	static int bitIndex(int64_t cx, int64_t cy) { return (int)((cx & (TileCells - 1)) * TileCells + (cy & (TileCells - 1))); }
+
+	int m_netId = -1;
+	double m_reach = 0;
+	double m_pitch = 1;
+	std::vector<std::pair<int, int>> m_layerPairs;
+	std::unordered_map<TileKey, Tile, TileKeyHash> m_tiles;
+};
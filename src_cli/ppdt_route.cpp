@@ -0,0 +1,255 @@
+// ppdt-route: headless PPDT router, loads a .dsn, runs MST + PPDT and writes metrics and routed geometry
+#include "../src_algorithms/src_dsn/DsnLoader.h"
+#include "../src_algorithms/src_dsn/MST.h"
+#include "../src_algorithms/src_dsn/RouterMeshless.h"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+	struct CliOptions {
+		string dsnFile;
+		string outPrefix;			// Defaults to the dsn file name without extension
+		double gridSize = 0;		// < 1: computed from alpha_g and the average pad area
+		double alpha_g = 3.0;
+		double beta = 0.4;
+		bool postOn = true;
+		bool GNDRouteOn = true;
+		bool VCCRouteOn = true;
+		bool diffRouteOn = true;
+		bool preViaAlctOn = false;
+		string flexibleOpt = "111111";
+		ObstacleIndexType indexType = ObstacleIndexType::Grid;
+		int refineThreshold = 24;
+		bool fixedPoint = false;	// Snap generated points to dsn database units
+		double bidirectional = 0;	// Pin pairs longer than this fraction of the board diagonal are searched from both pads
+		int lazyVia = 0;			// Routing layers from which via children are queued as one lazy marker, 0 = off
+	};
+
+	void printUsage() {
+		cout << "Usage: ppdt-route <board.dsn> [options]\n"
+			<< "  --out <prefix>       Output prefix, writes <prefix>.metrics.tsv and <prefix>.wiring.dsn\n"
+			<< "  --grid-size <v>      Grid size, values < 1 use alpha_g * sqrt(average pad area) (default 0)\n"
+			<< "  --alpha-g <v>        Grid size factor, > 0 (default 3.0)\n"
+			<< "  --beta <v>           Standard cost factor, > 0 (default 0.4)\n"
+			<< "  --post <0|1>         Post processing (default 1)\n"
+			<< "  --gnd <0|1>          Route GND net (default 1)\n"
+			<< "  --vcc <0|1>          Route VCC net (default 1)\n"
+			<< "  --diff <0|1>         Differential pair routing (default 1)\n"
+			<< "  --pre-via <0|1>      Steiner tree pre-via allocation (default 0)\n"
+			<< "  --flex <bits>        Flexible options, same 6 flags as the GUI (default 111111)\n"
+			<< "  --index <type>       Obstacle index: grid or quadtree (default grid)\n"
+			<< "  --refine <n>         Split grid cells holding more than n records into finer cells, 0 = uniform grid (default 24)\n"
+			<< "  --fixed-point <0|1>  Snap generated points to integer database units of the dsn resolution (default 0)\n"
+			<< "  --bidir <v>          Search pin pairs longer than v * board diagonal from both pads, 0 = one-sided (default 0)\n"
+			<< "  --lazy-via <n>       Queue the via children of a node as one lazy marker on boards with n or more routing layers, 0 = off (default 0)\n";
+	}
+
+	// Accepted range of a numeric option
+	enum class Range { Any, NonNegative, Positive };
+	bool inRange(double v, Range range) {
+		if (range == Range::NonNegative) return v >= 0;
+		if (range == Range::Positive) return v > 0;
+		return true;
+	}
+	// Whole value as a finite number in range, reports "invalid value for <opt>" otherwise
+	bool parseDouble(const string& arg, const string& value, double& out, Range range = Range::Any) {
+		size_t used = 0;
+		try {
+			out = stod(value, &used);
+		}
+		catch (const exception&) {
+			used = 0;
+		}
+		if (used == 0 || used != value.size() || !isfinite(out) || !inRange(out, range)) {
+			cerr << "Error: invalid value for " << arg << ": " << value << endl;
+			return false;
+		}
+		return true;
+	}
+	bool parseInt(const string& arg, const string& value, int& out, Range range = Range::Any) {
+		size_t used = 0;
+		try {
+			out = stoi(value, &used);
+		}
+		catch (const exception&) {
+			used = 0;
+		}
+		if (used == 0 || used != value.size() || !inRange(out, range)) {
+			cerr << "Error: invalid value for " << arg << ": " << value << endl;
+			return false;
+		}
+		return true;
+	}
+	// Switches take 0 or 1 only, so a typo does not silently turn an option on
+	bool parseBool(const string& arg, const string& value, bool& out) {
+		if (value != "0" && value != "1") {
+			cerr << "Error: invalid value for " << arg << ": " << value << " (expected 0 or 1)" << endl;
+			return false;
+		}
+		out = value == "1";
+		return true;
+	}
+
+	bool parseArgs(int argc, char** argv, CliOptions& opts) {
+		for (int i = 1; i < argc; ++i) {
+			string arg = argv[i];
+			if (arg == "-h" || arg == "--help")
+				return false;
+			if (arg.rfind("--", 0) != 0) {
+				if (!opts.dsnFile.empty()) {
+					cerr << "Error: more than one dsn file given: " << opts.dsnFile << ", " << arg << endl;
+					return false;
+				}
+				opts.dsnFile = arg;
+				continue;
+			}
+			if (i + 1 >= argc) {
+				cerr << "Error: missing value for " << arg << endl;
+				return false;
+			}
+			string value = argv[++i];
+			if (arg == "--out") opts.outPrefix = value;
+			else if (arg == "--grid-size") { if (!parseDouble(arg, value, opts.gridSize, Range::NonNegative)) return false; }
+			else if (arg == "--alpha-g") { if (!parseDouble(arg, value, opts.alpha_g, Range::Positive)) return false; }
+			else if (arg == "--beta") { if (!parseDouble(arg, value, opts.beta, Range::Positive)) return false; }
+			else if (arg == "--post") { if (!parseBool(arg, value, opts.postOn)) return false; }
+			else if (arg == "--gnd") { if (!parseBool(arg, value, opts.GNDRouteOn)) return false; }
+			else if (arg == "--vcc") { if (!parseBool(arg, value, opts.VCCRouteOn)) return false; }
+			else if (arg == "--diff") { if (!parseBool(arg, value, opts.diffRouteOn)) return false; }
+			else if (arg == "--pre-via") { if (!parseBool(arg, value, opts.preViaAlctOn)) return false; }
+			else if (arg == "--flex") opts.flexibleOpt = value;
+			else if (arg == "--refine") { if (!parseInt(arg, value, opts.refineThreshold, Range::NonNegative)) return false; }
+			else if (arg == "--fixed-point") { if (!parseBool(arg, value, opts.fixedPoint)) return false; }
+			else if (arg == "--bidir") { if (!parseDouble(arg, value, opts.bidirectional, Range::NonNegative)) return false; }
+			else if (arg == "--lazy-via") { if (!parseInt(arg, value, opts.lazyVia, Range::NonNegative)) return false; }
+			else if (arg == "--index") {
+				if (value == "grid") opts.indexType = ObstacleIndexType::Grid;
+				else if (value == "quadtree") opts.indexType = ObstacleIndexType::QuadTree;
+				else {
+					cerr << "Error: unknown index type " << value << endl;
+					return false;
+				}
+			}
+			else {
+				cerr << "Error: unknown option " << arg << endl;
+				return false;
+			}
+		}
+		if (opts.dsnFile.empty()) {
+			cerr << "Error: no dsn file given" << endl;
+			return false;
+		}
+		if (opts.outPrefix.empty()) {
+			size_t dot = opts.dsnFile.find_last_of('.');
+			size_t slash = opts.dsnFile.find_last_of("/\\");
+			opts.outPrefix = (dot != string::npos && (slash == string::npos || dot > slash)) ? opts.dsnFile.substr(0, dot) : opts.dsnFile;
+		}
+		return true;
+	}
+
+	string layerName(const DsnBoard& board, int layer) {
+		auto it = board.layers.find(layer);
+		return it != board.layers.end() ? it->second : to_string(layer);
+	}
+
+	// Routed geometry in the dsn (wiring ...) format, same layout as the routed case files
+	bool writeWiring(const string& fileName, const DsnBoard& board, RouterMeshless& router, const unordered_map<string, PinPad>& preVias) {
+		ofstream ofs(fileName);
+		if (!ofs.is_open()) {
+			cerr << "Error: cannot open output file: " << fileName << endl;
+			return false;
+		}
+		auto viaName = [&board](const string& netName) {
+			auto it = board.netsInfos.find(netName);
+			return it != board.netsInfos.end() ? it->second.viaName : string("via0");
+		};
+		ofs << "(wiring\n";
+		for (const auto& [pNode, shape] : *router.getPaths()) {
+			for (const PathLine& line : shape.edges) {
+				ofs << "  (wire(path " << layerName(board, line.layer) << " " << line.width << " "
+					<< line.p1->pos.x << " " << line.p1->pos.y << " " << line.p2->pos.x << " " << line.p2->pos.y << " )\n"
+					<< "    (net " << shape.shapeName << ")\n"
+					<< "    (type protect)\n"
+					<< "  )\n";
+			}
+		}
+		auto writeVia = [&](const PinPad& pad) {
+			ofs << "  (via " << viaName(pad.netName) << " " << pad.pos.x << " " << pad.pos.y << "\n"
+				<< "    (net " << pad.netName << ")\n"
+				<< "    (type protect)\n"
+				<< "  )\n";
+		};
+		for (const auto& [name, pad] : preVias)
+			writeVia(pad);
+		for (const auto& [pos, pad] : *router.getVias())
+			writeVia(pad);
+		ofs << ")\n";
+		return true;
+	}
+}
+
+int main(int argc, char** argv) {
+	CliOptions opts;
+	if (!parseArgs(argc, argv, opts)) {
+		printUsage();
+		return 1;
+	}
+	//1. Data initialization
+	DsnBoard board;
+	DsnLoader loader;
+	if (!loader.readFile(opts.dsnFile, board))
+		return 1;
+	cout << "Min:(" << board.bound[0] << ", " << board.bound[1] << "),"
+		<< "Max:(" << board.bound[2] << ", " << board.bound[3] << "),"
+		<< "\tNet:" << board.nets.size() << ",\tpinsSum:" << board.pads.size() << endl;
+	//2. Compute minimum spanning tree MST
+	SteinerTreeSolver solver;
+	unordered_map<string, shared_ptr<SteinerNode>> netTrees;
+	unordered_map<string, PinPad> preVias;
+	solver.computeSteinerTrees(board.nets, board.netsInfos, netTrees);
+	if (opts.preViaAlctOn)		// Steiner tree, pre-via allocation
+		solver.setSteinerNodes(board.netsInfos, board.viaInfos, netTrees, preVias);
+	//3. Router parameter settings
+	RouterMeshless router(&netTrees, &board.pads, &preVias, &board.bound, &board.viaInfos, &board.netsInfos, &board.nets);
+	router.setRouterOption({ opts.postOn, opts.GNDRouteOn, opts.VCCRouteOn, opts.diffRouteOn });
+	router.setDebugOpt(opts.flexibleOpt, false, Point(0, 0), 0);
+	router.setGrideSizeFactor(opts.alpha_g);
+	router.setStandardCostFactor(opts.beta);
+	router.setObstacleIndexType(opts.indexType);
+	router.setGridRefineThreshold(opts.refineThreshold);
+	router.setCoordinateResolution(opts.fixedPoint ? board.resolution : 0);
+	router.setBidirectionalFactor(opts.bidirectional);
+	router.setLazyViaLayers(opts.lazyVia);
+	//4. Router data cleaning, establish spatial grid index, route
+	double gridSize = opts.gridSize;
+	auto t1 = chrono::high_resolution_clock::now();
+	router.routerReset(gridSize);
+	vector<string> routingInfo;
+	router.run(routingInfo);
+	auto t2 = chrono::high_resolution_clock::now();
+	//5. Output metrics and routed geometry
+	auto time = chrono::duration_cast<chrono::milliseconds>(t2 - t1).count();
+	cout << "Time:" << time << " ms" << ", gridSize:" << gridSize << ", alpha_g:" << opts.alpha_g << ", beta:" << opts.beta << endl;
+	string metricsName = opts.outPrefix + ".metrics.tsv";
+	ofstream ofs(metricsName);
+	if (!ofs.is_open()) {
+		cerr << "Error: cannot open output file: " << metricsName << endl;
+		return 1;
+	}
+	ofs << "Layers\tPairs\tFound\tFailed\tRateP\tAvgLen\tVia\tRateN\t";
+	ofs << "Time\tgridSize\talpha_g\tbeta\n";
+	for (auto& info : routingInfo)
+		ofs << info << "\t";
+	ofs << time << "\t" << gridSize << "\t" << opts.alpha_g << "\t" << opts.beta << "\n";
+	ofs.close();
+	if (!writeWiring(opts.outPrefix + ".wiring.dsn", board, router, preVias))
+		return 1;
+	return 0;
+}
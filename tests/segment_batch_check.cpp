@@ -0,0 +1,168 @@
+// segment-batch-check: findBlockingEdges (AVX2 path when the CPU has it, and the scalar path) against Line::distanceToLine
+// Every edge must get the same distance as the reference (up to rounding), exactly 0 whenever the reference snaps it
+// to 0, and the same blocking decision for clearances just above and just below that distance
+#include "../src_algorithms/src_basics/dataStructAlg.h"
+#include "../src_algorithms/src_dsn/SegmentBatch.h"
+
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+	const double DistTolerance = 1e-9;		// Relative to the coordinate scale, the paths round differently
+
+	struct Edge {
+		Point a, b;
+	};
+
+	struct Checker {
+		long edges = 0;
+		long zeros = 0;
+		long failures = 0;
+
+		void fail(const string& path, const string& what, const Point& q1, const Point& q2, const Edge& e, double ref, double got) {
+			if (++failures <= 10) {
+				cerr.precision(17);
+				cerr << "Error: " << path << " " << what << " for query (" << q1.x << ", " << q1.y << ")-(" << q2.x << ", " << q2.y
+					<< ") edge (" << e.a.x << ", " << e.a.y << ")-(" << e.b.x << ", " << e.b.y << "): reference " << ref << ", got " << got << endl;
+			}
+		}
+
+		// One query segment against a group of edges, through one path of findBlockingEdges
+		void checkPath(const string& path, const function<int(const Vec2&, const Vec2&, SegmentBatch&)>& find,
+			const Point& q1, const Point& q2, const vector<Edge>& group, const vector<double>& refs, mt19937& rng) {
+			double scale = 1;
+			for (const Point& p : { q1, q2 })
+				scale = max(scale, max(abs(p.x), abs(p.y)));
+			for (const Edge& e : group)
+				scale = max(scale, max(max(abs(e.a.x), abs(e.a.y)), max(abs(e.b.x), abs(e.b.y))));
+			double tolerance = DistTolerance * scale;
+
+			// Distances, read back from violation = 1 - dist^2
+			SegmentBatch batch;
+			for (const Edge& e : group)
+				batch.add(e.a, e.b, 1);
+			find(q1, q2, batch);
+			vector<bool> atSnap(group.size());
+			for (size_t i = 0; i < group.size(); ++i) {
+				double dist = sqrt(max(0.0, 1 - batch.violation[i]));
+				double ref = refs[i];
+				// The snap compares squared distances here, only a value right at MapMinValue may snap differently
+				atSnap[i] = abs(max(dist, ref) - MapMinValue) <= tolerance;
+				if ((ref == 0) != (dist == 0) && !atSnap[i])
+					fail(path, "snap differs", q1, q2, group[i], ref, dist);
+				else if (abs(dist - ref) > tolerance && !atSnap[i])
+					fail(path, "distance differs", q1, q2, group[i], ref, dist);
+			}
+
+			// Blocking decisions for clearances on both sides of the reference distance
+			for (double side : { -1.0, 1.0 }) {
+				batch.clear();
+				vector<double> minDist(group.size());
+				for (size_t i = 0; i < group.size(); ++i) {
+					minDist[i] = rng() % 8 == 0 ? (double)(rng() % 4) : refs[i] + side * 10 * tolerance;
+					batch.add(group[i].a, group[i].b, minDist[i]);
+				}
+				int blocked = find(q1, q2, batch);
+				int violations = 0;
+				for (size_t i = 0; i < group.size(); ++i) {
+					bool refBlocked = minDist[i] > 0 && refs[i] < minDist[i];
+					violations += batch.violation[i] > 0;
+					if ((batch.violation[i] > 0) != refBlocked && abs(refs[i] - minDist[i]) > tolerance && !atSnap[i])
+						fail(path, "blocking differs", q1, q2, group[i], refs[i], batch.violation[i]);
+				}
+				if (blocked != violations)
+					fail(path, "returned count differs", q1, q2, group[0], violations, blocked);
+			}
+		}
+
+		void check(const Point& q1, const Point& q2, const vector<Edge>& group, mt19937& rng) {
+			Line query(q1, q2);
+			vector<double> refs;
+			for (const Edge& e : group) {
+				refs.push_back(query.distanceToLine(Line(e.a, e.b)));
+				zeros += refs.back() == 0;
+			}
+			edges += group.size();
+			checkPath("findBlockingEdges", findBlockingEdges, q1, q2, group, refs, rng);
+			checkPath("scalar", findBlockingEdgesScalar, q1, q2, group, refs, rng);
+		}
+	};
+}
+
+int main() {
+	mt19937 rng(2024);
+	Checker checker;
+	uniform_real_distribution<double> coord(-100, 100);
+	uniform_int_distribution<int> groupSize(1, 9);		// Full AVX2 lanes and scalar tails
+	auto randomPoint = [&]() { return Point(coord(rng), coord(rng)); };
+
+	// 1. Random segment pairs
+	for (int n = 0; n < 30000; ++n) {
+		Point q1 = randomPoint(), q2 = randomPoint();
+		vector<Edge> group;
+		for (int k = groupSize(rng); k > 0; --k)
+			group.push_back({ randomPoint(), randomPoint() });
+		checker.check(q1, q2, group, rng);
+	}
+
+	// 2. Small integer lattice, plenty of exactly collinear, touching and shared endpoints, and zero length segments
+	uniform_int_distribution<int> lattice(0, 6);
+	auto latticePoint = [&]() { return Point(lattice(rng), lattice(rng)); };
+	for (int n = 0; n < 10000; ++n) {
+		Point q1 = latticePoint(), q2 = latticePoint();
+		vector<Edge> group;
+		for (int k = groupSize(rng); k > 0; --k)
+			group.push_back({ latticePoint(), latticePoint() });
+		checker.check(q1, q2, group, rng);
+	}
+
+	// 3. Edges parallel to the query or in line with it, at offsets and gaps around the MapMinValue snap
+	const double offsets[] = { 0, 1e-7, 1e-4, 0.003, 0.0049, 0.00499999, 0.00500001, 0.0051, 0.007, 0.02 };
+	const double gaps[] = { -0.5, 0, 1e-6, 0.002, 0.0035, 0.0049, 0.0051, 0.0071, 0.1 };
+	uniform_real_distribution<double> angle(0, 2 * PI), length(0.001, 20);
+	for (int n = 0; n < 400; ++n) {
+		Point q1 = randomPoint();
+		// Axis aligned and diagonal directions too, where the grown box of Line::intersects reaches furthest
+		double a = n % 4 == 0 ? angle(rng) : (n % 4) * PI / 4;
+		Point dir(cos(a), sin(a)), normal(-sin(a), cos(a));
+		double len = length(rng);
+		Point q2 = q1 + dir * len;
+		vector<Edge> group;
+		for (double offset : offsets) {
+			for (double gap : gaps) {
+				double edgeLen = length(rng);
+				Point a1 = q2 + dir * gap + normal * offset;
+				group.push_back({ a1, a1 + dir * edgeLen });
+				// T junction: edge ending next to the inside of the query
+				Point mid = q1 + dir * (len / 2) + normal * (offset + gap);
+				group.push_back({ mid, mid + normal * edgeLen });
+				// Zero length edge next to the query end
+				Point p = q2 + dir * gap + normal * offset;
+				group.push_back({ p, p });
+			}
+		}
+		checker.check(q1, q2, group, rng);
+		checker.check(q2, q1, group, rng);
+	}
+
+	// 4. Shared endpoints and crossings right at an endpoint
+	for (int n = 0; n < 2000; ++n) {
+		Point q1 = randomPoint(), q2 = randomPoint();
+		vector<Edge> group = {
+			{ q2, randomPoint() }, { randomPoint(), q1 }, { q1, q2 }, { q2, q1 },
+			{ q1 + (q2 - q1) * 0.5, randomPoint() }, { q1, q1 }, { q2 + Point(1e-9, -1e-9), randomPoint() }
+		};
+		checker.check(q1, q2, group, rng);
+		checker.check(q1, q1, group, rng);
+	}
+
+	cout << "AVX2 path " << (findBlockingEdgesUsesAvx2() ? "on" : "off (not supported, both runs use the scalar path)")
+		<< ", edges " << checker.edges << " (" << checker.zeros << " at distance 0), failures " << checker.failures << endl;
+	return checker.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+// snapshot-stress: reader/writer stress test of the obstacle index snapshots, built with -fsanitize=thread
+// One writer adds and removes traces and pads and publishes a snapshot after each batch, recording what a fixed set of
+// probe lines hits at that version; readers query the latest snapshot at the same time and must get the recorded
+// answers. A cell or sub-grid modified in place instead of copied (writableCell / writableSubGrid) shows up as a wrong
+// answer or as a race report
+#include "../src_algorithms/src_dsn/Grid.h"
+#include "../src_algorithms/src_dsn/CollisionQuery.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+	const int Layers = 2;
+	const double BoardSize = 200;
+	const double CellSize = 10;
+	const int RefineThreshold = 4;		// Low, so that sub-grids are created and copied too
+	const double ProbeWidth = 2;
+
+	// Blocking obstacles of every probe line, sorted
+	typedef vector<vector<PolyShape*>> Answers;
+
+	struct Probe {
+		Line line;
+		int layer;
+	};
+
+	// Owns every obstacle until the end, readers of a snapshot may still hold records of removed ones
+	struct Board {
+		vector<unique_ptr<PinPad>> pads;
+		vector<unique_ptr<PolyShape>> traces;
+		vector<unique_ptr<PathNode>> nodes;
+		vector<PinPad*> livePads;
+		vector<PolyShape*> liveTraces;
+	};
+
+	PolyShape* makeTrace(Board& board, mt19937& rng, int net) {
+		uniform_real_distribution<double> coord(5, BoardSize - 5);
+		uniform_real_distribution<double> step(-30, 30);
+		int layer = (int)(rng() % Layers);
+		string netName = "N" + to_string(net);
+		auto shape = make_unique<PolyShape>(vector<PathLine>(), layer, true, 0.5, netName);
+		Point pos(coord(rng), coord(rng));
+		PathNode* prev = nullptr;
+		for (int i = 0; i < 4; ++i) {
+			board.nodes.push_back(make_unique<PathNode>(pos, shape.get(), netName, layer));
+			PathNode* node = board.nodes.back().get();
+			if (prev)
+				shape->edges.emplace_back(prev, node, layer, 1.0);
+			prev = node;
+			pos = Point(clamp(pos.x + step(rng), 1.0, BoardSize - 1), clamp(pos.y + step(rng), 1.0, BoardSize - 1));
+		}
+		board.traces.push_back(move(shape));
+		return board.traces.back().get();
+	}
+
+	PinPad* makePad(Board& board, mt19937& rng, int net) {
+		uniform_real_distribution<double> coord(5, BoardSize - 5);
+		uniform_real_distribution<double> radius(0.5, 3);
+		auto pad = make_unique<PinPad>(Point(coord(rng), coord(rng)), "pad", "P" + to_string(net), 0.5);
+		double r = radius(rng);
+		for (int layer = 0; layer < Layers; ++layer)
+			pad->addShape(layer, r, Point(0, 0));
+		board.pads.push_back(move(pad));
+		return board.pads.back().get();
+	}
+
+	void queryProbes(const ObstacleIndex& index, ObstacleQuery& query, const vector<Probe>& probes, Answers& answers) {
+		answers.assign(probes.size(), {});
+		OtherNetsFilter filter;
+		filter.halfWidth = ProbeWidth / 2;
+		filter.clearance = 0.5;
+		for (size_t i = 0; i < probes.size(); ++i) {
+			CollectAll result(answers[i]);
+			queryObstacles(index, query, probes[i].line, ProbeWidth, probes[i].layer, filter, result);
+			sort(answers[i].begin(), answers[i].end());
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	int batches = argc > 1 ? atoi(argv[1]) : 400;
+	const int readerCount = 3;
+
+	mt19937 rng(12345);
+	vector<Probe> probes;
+	uniform_real_distribution<double> coord(0, BoardSize);
+	for (int i = 0; i < 24; ++i)
+		probes.push_back({ Line(Point(coord(rng), coord(rng)), Point(coord(rng), coord(rng))), i % Layers });
+
+	GridManager index(0, 0, BoardSize, BoardSize, CellSize, RefineThreshold);
+	Board board;
+	ObstacleQuery writerQuery;
+	mutex expectedMutex;
+	map<uint64_t, Answers> expected;		// Probe answers of every published version
+
+	// Writer thread only: record the answers of the live index, then publish it
+	auto publish = [&]() {
+		Answers answers;
+		queryProbes(index, writerQuery, probes, answers);
+		{
+			lock_guard<mutex> lock(expectedMutex);
+			expected.emplace(index.getVersion(), move(answers));
+		}
+		index.publishSnapshot();
+	};
+	int net = 0;
+	for (int i = 0; i < 30; ++i) {
+		PolyShape* trace = makeTrace(board, rng, net++);
+		index.addShapeLines(trace);
+		board.liveTraces.push_back(trace);
+	}
+	publish();
+
+	atomic<bool> done(false);
+	atomic<long> checks(0);
+	atomic<int> failures(0);
+	auto reader = [&]() {
+		ObstacleQuery query;
+		Answers answers;
+		while (!done.load()) {
+			shared_ptr<const ObstacleIndex> snapshot = index.getSnapshot();
+			uint64_t version = snapshot->getVersion();
+			// Query twice, the writer keeps modifying the live index in between
+			for (int pass = 0; pass < 2; ++pass) {
+				queryProbes(*snapshot, query, probes, answers);
+				lock_guard<mutex> lock(expectedMutex);
+				auto it = expected.find(version);
+				if (it == expected.end() || it->second != answers) {
+					cerr << "Error: snapshot at version " << version << " changed under a reader" << endl;
+					++failures;
+				}
+			}
+			++checks;
+		}
+	};
+	vector<thread> readers;
+	for (int i = 0; i < readerCount; ++i)
+		readers.emplace_back(reader);
+
+	for (int b = 0; b < batches; ++b) {
+		for (int op = 0; op < 4; ++op) {
+			switch (rng() % 4) {
+			case 0: {
+				PolyShape* trace = makeTrace(board, rng, net++);
+				index.addShapeLines(trace);
+				board.liveTraces.push_back(trace);
+				break;
+			}
+			case 1:
+				if (!board.liveTraces.empty()) {
+					size_t k = rng() % board.liveTraces.size();
+					index.removeOnePath(board.liveTraces[k]);
+					board.liveTraces.erase(board.liveTraces.begin() + k);
+				}
+				break;
+			case 2: {
+				PinPad* pad = makePad(board, rng, net++);
+				index.addPinPad(pad);
+				board.livePads.push_back(pad);
+				break;
+			}
+			default:
+				if (!board.livePads.empty()) {
+					size_t k = rng() % board.livePads.size();
+					index.removePinPad(board.livePads[k]);
+					board.livePads.erase(board.livePads.begin() + k);
+				}
+				break;
+			}
+		}
+		publish();
+		if (b % 8 == 0)
+			this_thread::yield();
+	}
+	done = true;
+	for (thread& t : readers)
+		t.join();
+
+	// The last snapshot still has to agree once the writer is done
+	Answers answers;
+	ObstacleQuery query;
+	queryProbes(*index.getSnapshot(), query, probes, answers);
+	if (answers != expected[index.getVersion()]) {
+		cerr << "Error: last snapshot differs from the live index" << endl;
+		++failures;
+	}
+	cout << "batches " << batches << ", reader checks " << checks.load() << ", failures " << failures.load() << endl;
+	return failures.load() == 0 && checks.load() > 0 ? 0 : 1;
+}